@@ -0,0 +1,428 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef APOLLO_ARRAY_VIEW_HPP_INCLUDED
+#define APOLLO_ARRAY_VIEW_HPP_INCLUDED APOLLO_ARRAY_VIEW_HPP_INCLUDED
+
+// Numeric arrays that Lua accesses in place, without copying them to tables:
+// array_view<T> refers to memory owned by C++ and owned_array<T> owns its
+// elements. After register_array<T>(), scripts can use a[i] (with 1-based,
+// bounds checked indices), #a and the bulk operations listed at
+// register_array().
+
+#include <apollo/class.hpp>
+#include <apollo/raw_function.hpp>
+
+#include <boost/assert.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace apollo {
+
+template <typename T>
+class array_view {
+    // char is converted to and from one-character strings, not numbers; use
+    // signed char or unsigned char for arrays of bytes.
+    static_assert(
+        std::is_arithmetic<T>::value && !std::is_same<T, bool>::value
+        && !std::is_same<T, char>::value && !std::is_same<T, wchar_t>::value,
+        "array_view: only numeric element types are supported.");
+public:
+    using value_type = T;
+
+    array_view() BOOST_NOEXCEPT: m_data(nullptr), m_size(0) {}
+
+    array_view(T* data, std::size_t size) BOOST_NOEXCEPT
+        : m_data(data), m_size(size)
+    { }
+
+    T* data() const BOOST_NOEXCEPT { return m_data; }
+    std::size_t size() const BOOST_NOEXCEPT { return m_size; }
+    bool empty() const BOOST_NOEXCEPT { return m_size == 0; }
+
+    T* begin() const BOOST_NOEXCEPT { return m_data; }
+    T* end() const BOOST_NOEXCEPT { return m_data + m_size; }
+
+    T& operator[] (std::size_t i) const
+    {
+        BOOST_ASSERT(i < m_size);
+        return m_data[i];
+    }
+
+protected:
+    void reset(T* data, std::size_t size) BOOST_NOEXCEPT
+    {
+        m_data = data;
+        m_size = size;
+    }
+
+private:
+    T* m_data;
+    std::size_t m_size;
+};
+
+// An array_view of its own elements. The elements are copied (or moved)
+// together with the owned_array.
+template <typename T>
+class owned_array: public array_view<T> {
+public:
+    explicit owned_array(std::size_t size = 0, T const& v = T())
+        : m_storage(size, v)
+    {
+        reset_view();
+    }
+
+    explicit owned_array(std::vector<T> storage)
+        : m_storage(std::move(storage))
+    {
+        reset_view();
+    }
+
+    owned_array(owned_array const& other)
+        : array_view<T>(), m_storage(other.m_storage)
+    {
+        reset_view();
+    }
+
+    owned_array(owned_array&& other) BOOST_NOEXCEPT
+        : array_view<T>(), m_storage(std::move(other.m_storage))
+    {
+        reset_view();
+        other.reset_view();
+    }
+
+    owned_array& operator= (owned_array const& other)
+    {
+        m_storage = other.m_storage;
+        reset_view();
+        return *this;
+    }
+
+    owned_array& operator= (owned_array&& other) BOOST_NOEXCEPT
+    {
+        m_storage = std::move(other.m_storage);
+        reset_view();
+        other.reset_view();
+        return *this;
+    }
+
+    std::vector<T> const& storage() const BOOST_NOEXCEPT { return m_storage; }
+
+private:
+    void reset_view() BOOST_NOEXCEPT
+    {
+        this->reset(m_storage.data(), m_storage.size());
+    }
+
+    std::vector<T> m_storage;
+};
+
+namespace detail {
+
+// The kernels of the bulk operations. They are plain loops over contiguous
+// memory, which the compiler can vectorize. Sums and extrema use several
+// independent accumulators, so that they are not limited by the latency of
+// a single dependency chain (and can be vectorized without reassociating
+// floating point operations).
+
+// Integers narrower than long long are summed exactly, in long long or (for
+// unsigned types) unsigned long long, which cannot overflow for up to
+// max_exact_array_sum elements. Other arrays are summed in double.
+template <typename T>
+struct has_exact_array_sum: std::integral_constant<bool,
+    std::is_integral<T>::value && sizeof(T) < sizeof(long long)> {};
+
+template <typename T>
+using exact_array_sum_t = typename std::conditional<
+    std::is_signed<T>::value, long long, unsigned long long>::type;
+
+BOOST_CONSTEXPR_OR_CONST unsigned long long max_exact_array_sum =
+    0xffffffffull;
+
+template <typename Sum, typename T>
+Sum array_sum(T const* p, std::size_t n) BOOST_NOEXCEPT
+{
+    using sum_t = Sum;
+    sum_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += static_cast<sum_t>(p[i]);
+        s1 += static_cast<sum_t>(p[i + 1]);
+        s2 += static_cast<sum_t>(p[i + 2]);
+        s3 += static_cast<sum_t>(p[i + 3]);
+    }
+    for (; i < n; ++i)
+        s0 += static_cast<sum_t>(p[i]);
+    return (s0 + s1) + (s2 + s3);
+}
+
+// Precondition: n > 0. Returns the first minimum if IsMax is false and the
+// first maximum otherwise (NaNs are ignored unless p[0] is one).
+template <bool IsMax, typename T>
+T array_extremum(T const* p, std::size_t n) BOOST_NOEXCEPT
+{
+    BOOST_ASSERT(n > 0);
+    T m[4] = {p[0], p[0], p[0], p[0]};
+    std::size_t i = 1;
+    for (; i + 4 <= n; i += 4) {
+        for (std::size_t j = 0; j < 4; ++j) {
+            T const v = p[i + j];
+            m[j] = (IsMax ? m[j] < v : v < m[j]) ? v : m[j];
+        }
+    }
+    for (; i < n; ++i)
+        m[0] = (IsMax ? m[0] < p[i] : p[i] < m[0]) ? p[i] : m[0];
+    for (std::size_t j = 1; j < 4; ++j)
+        m[0] = (IsMax ? m[0] < m[j] : m[j] < m[0]) ? m[j] : m[0];
+    return m[0];
+}
+
+template <typename T>
+void array_fill(T* p, std::size_t n, T v) BOOST_NOEXCEPT
+{
+    for (std::size_t i = 0; i < n; ++i)
+        p[i] = v;
+}
+
+template <typename T, typename F>
+void array_scale(T* p, std::size_t n, F factor) BOOST_NOEXCEPT
+{
+    for (std::size_t i = 0; i < n; ++i)
+        p[i] = static_cast<T>(static_cast<F>(p[i]) * factor);
+}
+
+// y += a * x. x and y may be the same array but must not overlap otherwise.
+template <typename T, typename F>
+void array_axpy(T* y, T const* x, std::size_t n, F a) BOOST_NOEXCEPT
+{
+    for (std::size_t i = 0; i < n; ++i)
+        y[i] = static_cast<T>(
+            static_cast<F>(y[i]) + a * static_cast<F>(x[i]));
+}
+
+// The factor type of scale() and axpy(). Results for integer arrays are
+// truncated.
+template <typename T>
+using array_factor_t = typename std::conditional<
+    std::is_floating_point<T>::value, T, double>::type;
+
+// Returns the array at idx or raises a Lua error. The instance at idx is an
+// array_view<T> or an owned_array<T>.
+template <typename T>
+array_view<T>& check_array(lua_State* L, int idx, bool for_writing)
+{
+    if (!is_apollo_instance(L, idx))
+        luaL_argerror(L, idx, "array expected");
+    auto const& header = *as_header(L, idx);
+    if (for_writing && header.is_const)
+        luaL_argerror(L, idx, "array is const");
+    void* obj = instance_object(header);
+    if (!obj)
+        luaL_argerror(L, idx, "array is null");
+    char const* err;
+    obj = try_cast_class(
+        obj, *header.cls, static_class_id<array_view<T>>::id, err);
+    if (err)
+        luaL_argerror(L, idx, err);
+    return *static_cast<array_view<T>*>(obj);
+}
+
+// Converts the key at idx to a 0-based index into a or raises a Lua error.
+template <typename T>
+std::size_t check_array_index(lua_State* L, int idx, array_view<T> const& a)
+{
+    // Only numbers are indices (not numeric strings, which lua_tointegerx()
+    // would accept), so that all Lua versions behave the same.
+    bool is_integer = false;
+    lua_Integer i = 0;
+    if (lua_type(L, idx) == LUA_TNUMBER) {
+#if LUA_VERSION_NUM >= 503
+        int isnum;
+        i = lua_tointegerx(L, idx, &isnum);
+        is_integer = isnum != 0;
+#else
+        lua_Number const n = lua_tonumber(L, idx);
+        // Casting NaN or numbers out of lua_Integer's range is undefined, so
+        // only numbers in the array's range are cast (others keep i == 0).
+        if (n >= 1 && n <= static_cast<lua_Number>(a.size())) {
+            i = static_cast<lua_Integer>(n);
+            is_integer = static_cast<lua_Number>(i) == n;
+        } else {
+            is_integer = std::floor(n) == n;
+        }
+#endif
+    }
+    if (BOOST_UNLIKELY(!is_integer || i < 1
+        || static_cast<unsigned long long>(i) > a.size())
+    ) {
+        if (!is_integer) {
+            luaL_error(L, "Invalid array index (%s given).",
+                luaL_typename(L, idx));
+        }
+        lua_pushvalue(L, idx);
+        lua_pushinteger(L, static_cast<lua_Integer>(a.size()));
+        luaL_error(L, "Array index %s out of range (size is %s).",
+            lua_tostring(L, -2), lua_tostring(L, -1));
+    }
+    return static_cast<std::size_t>(i - 1);
+}
+
+template <typename T>
+T check_array_value(lua_State* L, int idx)
+{
+    if (converter<T>::n_conversion_steps(L, idx) == no_conversion) {
+        luaL_error(L, "Invalid value for array element (%s given).",
+            luaL_typename(L, idx));
+    }
+    return converter<T>::to(L, idx);
+}
+
+template <typename T>
+int array_get(lua_State* L)
+{
+    auto const& a = check_array<T>(L, 1, false);
+    return converter<T>::push(L, a[check_array_index(L, 2, a)]);
+}
+
+template <typename T>
+int array_set(lua_State* L)
+{
+    auto const& a = check_array<T>(L, 1, true);
+    a[check_array_index(L, 2, a)] = check_array_value<T>(L, 3);
+    return 0;
+}
+
+template <typename T>
+int array_len(lua_State* L)
+{
+    lua_pushinteger(L, static_cast<lua_Integer>(
+        check_array<T>(L, 1, false).size()));
+    return 1;
+}
+
+template <typename T>
+int array_fill_fn(lua_State* L)
+{
+    auto const& a = check_array<T>(L, 1, true);
+    array_fill(a.data(), a.size(), check_array_value<T>(L, 2));
+    return 0;
+}
+
+template <typename T>
+int array_sum_fn(lua_State* L)
+{
+    auto const& a = check_array<T>(L, 1, false);
+    APOLLO_DETAIL_CONSTCOND_BEGIN
+    if (has_exact_array_sum<T>::value && a.size() <= max_exact_array_sum) {
+    APOLLO_DETAIL_CONSTCOND_END
+        return push(L,
+            array_sum<exact_array_sum_t<T>>(a.data(), a.size()));
+    }
+    return push(L, array_sum<double>(a.data(), a.size()));
+}
+
+template <bool IsMax, typename T>
+int array_extremum_fn(lua_State* L)
+{
+    auto const& a = check_array<T>(L, 1, false);
+    if (a.empty())
+        return 0;
+    return converter<T>::push(L, array_extremum<IsMax>(a.data(), a.size()));
+}
+
+template <typename T>
+int array_scale_fn(lua_State* L)
+{
+    auto const& a = check_array<T>(L, 1, true);
+    array_scale(a.data(), a.size(),
+        check_array_value<array_factor_t<T>>(L, 2));
+    return 0;
+}
+
+template <typename T>
+void check_same_size(
+    lua_State* L, array_view<T> const& a, array_view<T> const& b)
+{
+    if (a.size() != b.size()) {
+        lua_pushinteger(L, static_cast<lua_Integer>(a.size()));
+        lua_pushinteger(L, static_cast<lua_Integer>(b.size()));
+        luaL_error(L, "Array sizes differ (%s and %s).",
+            lua_tostring(L, -2), lua_tostring(L, -1));
+    }
+}
+
+template <typename T>
+int array_axpy_fn(lua_State* L)
+{
+    auto const& y = check_array<T>(L, 1, true);
+    auto const f = check_array_value<array_factor_t<T>>(L, 2);
+    auto const& x = check_array<T>(L, 3, false);
+    check_same_size(L, y, x);
+    array_axpy(y.data(), x.data(), y.size(), f);
+    return 0;
+}
+
+template <typename T>
+int array_copy_fn(lua_State* L)
+{
+    auto const& dst = check_array<T>(L, 1, true);
+    auto const& src = check_array<T>(L, 2, false);
+    check_same_size(L, dst, src);
+    // The arrays may overlap (e.g. views into the same buffer); T is
+    // arithmetic, so memmove() copies correctly.
+    if (!src.empty())
+        std::memmove(dst.data(), src.data(), src.size() * sizeof(T));
+    return 0;
+}
+
+template <typename T>
+void set_array_len(lua_State* L)
+{
+    push_instance_metatable(L, registered_class<T>(L));
+    lua_pushliteral(L, "__len");
+    lua_pushcfunction(L, &array_len<typename T::value_type>);
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
+}
+
+} // namespace detail
+
+// Registers array_view<T> and owned_array<T> (derived from it). Besides
+// a[i], a[i] = v and #a, Lua code can use these bulk operations (results
+// for integer arrays are truncated):
+//
+// a:fill(v)        Sets all elements to v.
+// a:sum()          Returns the sum of all elements (exact for integers
+//                  narrower than long long, else as a double).
+// a:min(), a:max() Return the smallest/largest element or nothing if a is
+//                  empty.
+// a:scale(f)       Multiplies all elements by f.
+// a:axpy(f, x)     Adds f * x[i] to each a[i]; #x must be #a.
+// a:copy(src)      Copies the elements of src to a; #src must be #a.
+template <typename T>
+void register_array(lua_State* L)
+{
+    using view_t = array_view<T>;
+    register_class<view_t>(L);
+    add_indexer<view_t>(L, &detail::array_get<T>, &detail::array_set<T>);
+    add_method<view_t>(L, "fill", raw_function(&detail::array_fill_fn<T>));
+    add_method<view_t>(L, "sum", raw_function(&detail::array_sum_fn<T>));
+    add_method<view_t>(L, "min",
+        raw_function(&detail::array_extremum_fn<false, T>));
+    add_method<view_t>(L, "max",
+        raw_function(&detail::array_extremum_fn<true, T>));
+    add_method<view_t>(L, "scale", raw_function(&detail::array_scale_fn<T>));
+    add_method<view_t>(L, "axpy", raw_function(&detail::array_axpy_fn<T>));
+    add_method<view_t>(L, "copy", raw_function(&detail::array_copy_fn<T>));
+    detail::set_array_len<view_t>(L);
+
+    register_class<owned_array<T>, view_t>(L);
+    detail::set_array_len<owned_array<T>>(L);
+}
+
+} // namespace apollo
+
+#endif // APOLLO_ARRAY_VIEW_HPP_INCLUDED
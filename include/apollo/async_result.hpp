@@ -0,0 +1,231 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef APOLLO_ASYNC_RESULT_HPP_INCLUDED
+#define APOLLO_ASYNC_RESULT_HPP_INCLUDED APOLLO_ASYNC_RESULT_HPP_INCLUDED
+
+// A function returning a pending async_result<R> makes the calling coroutine
+// yield when it returns. Completing the result with resolve() or reject()
+// (e.g. from an event loop) resumes the coroutine, and the call returns the
+// value or raises the error there.
+
+#include <apollo/converters.hpp>
+#include <apollo/raw_function.hpp>
+#include <apollo/reference.hpp>
+
+#include <boost/assert.hpp>
+#include <boost/optional/optional.hpp>
+
+#include <memory>
+#include <string>
+
+#if LUA_VERSION_NUM < 502
+#    error "apollo/async_result.hpp requires Lua 5.2 or later (lua_yieldk)."
+#endif
+
+namespace apollo {
+
+namespace detail {
+
+// The type independent part of the state shared by all copies of an
+// async_result.
+class APOLLO_API async_state {
+public:
+    async_state(): m_done(false) {}
+
+    bool done() const { return m_done; }
+    bool suspended() const { return !m_thread.empty(); }
+    lua_State* thread() const { return m_thread.L(); }
+
+    // Called when the function returning the result returns to Lua on L:
+    // references L and returns yield_results, or pushes an error message and
+    // returns error_results if L cannot yield.
+    int suspend(lua_State* L);
+
+    // Resumes the suspended thread with the n_args values on top of its
+    // stack, which must be true and the results, or false and an error
+    // message. Returns the result of lua_resume().
+    int resume(int n_args);
+
+    // If not suspended, marks the result as failed. Otherwise resumes the
+    // thread so that the error is raised there.
+    int reject(std::string const& msg);
+
+    // Pushes the error message of a result rejected before it was returned.
+    int push_error(lua_State* L) const;
+
+protected:
+    void set_done() { BOOST_ASSERT(!m_done); m_done = true; }
+
+private:
+    registry_reference m_thread;
+    std::string m_error;
+    bool m_done;
+};
+
+template <typename R>
+struct async_state_of: async_state {
+    boost::optional<R> value;
+    void set_value(R&& v) { set_done(); value = std::move(v); }
+};
+
+template <>
+struct async_state_of<void>: async_state {
+    bool has_value = false;
+    void set_value() { set_done(); has_value = true; }
+};
+
+template <typename R>
+class async_result_base {
+public:
+    // Whether the result is known (or has already been passed on to Lua).
+    bool ready() const { return !m_state || m_state->done(); }
+
+    // Whether a coroutine is waiting for the result.
+    bool suspended() const { return m_state && m_state->suspended(); }
+
+    // The coroutine waiting for the result, or nullptr.
+    lua_State* thread() const
+    {
+        return suspended() ? m_state->thread() : nullptr;
+    }
+
+    // Raises msg as the error of the call. Returns the status of lua_resume()
+    // if a coroutine was resumed, else LUA_OK.
+    int reject(std::string const& msg)
+    {
+        BOOST_ASSERT(!ready());
+        auto const state = m_state; // The coroutine may reassign *this.
+        return state->reject(msg);
+    }
+
+protected:
+    using state_t = async_state_of<R>;
+
+    async_result_base(): m_state(std::make_shared<state_t>()) {}
+    explicit async_result_base(std::nullptr_t) {}
+
+    // Resumes the waiting coroutine with true and the n_values values on
+    // top of its stack.
+    int resume_with(int n_values)
+    {
+        auto const state = m_state; // The coroutine may reassign *this.
+        return state->resume(n_values + 1);
+    }
+
+    // Pushes true beneath the values to pass to the waiting coroutine.
+    lua_State* prepare_resume() const
+    {
+        lua_State* const L = m_state->thread();
+        lua_pushboolean(L, true);
+        return L;
+    }
+
+    int push_pending(lua_State* L) const
+    {
+        if (m_state->done())
+            return m_state->push_error(L);
+        return m_state->suspend(L);
+    }
+
+    std::shared_ptr<state_t> m_state; // Null for immediately ready results.
+};
+
+} // namespace detail
+
+// The result of a function that can be completed after the function has
+// returned. All copies refer to the same result, so one can be returned to
+// apollo and the other kept by whatever completes it. A coroutine waiting for
+// the result is referenced until the result is completed; results that are
+// never completed leave it suspended.
+template <typename R>
+class async_result: public detail::async_result_base<R> {
+    using base_t = detail::async_result_base<R>;
+    friend struct converter<async_result>;
+
+public:
+    // A pending result.
+    async_result() {}
+
+    // An immediately ready result: returned without yielding.
+    /* implicit */ async_result(R value)
+        : base_t(nullptr), m_value(std::move(value))
+    {}
+
+    // Completes the result with value. Returns the status of lua_resume() if
+    // a coroutine was resumed, else LUA_OK (a function resolving its result
+    // before returning simply returns the value).
+    int resolve(R value)
+    {
+        BOOST_ASSERT(!this->ready());
+        if (!this->suspended()) {
+            this->m_state->set_value(std::move(value));
+            return LUA_OK;
+        }
+        lua_State* const L = this->prepare_resume();
+        return this->resume_with(apollo::push(L, std::move(value)));
+    }
+
+private:
+    int push(lua_State* L)
+    {
+        if (m_value)
+            return apollo::push(L, std::move(*m_value));
+        if (this->m_state->value)
+            return apollo::push(L, std::move(*this->m_state->value));
+        return this->push_pending(L);
+    }
+
+    boost::optional<R> m_value;
+};
+
+template <>
+class async_result<void>: public detail::async_result_base<void> {
+    using base_t = detail::async_result_base<void>;
+    friend struct converter<async_result>;
+
+public:
+    async_result() {}
+
+    static async_result ready_result() { return async_result(nullptr); }
+
+    int resolve()
+    {
+        BOOST_ASSERT(!this->ready());
+        if (!this->suspended()) {
+            m_state->set_value();
+            return LUA_OK;
+        }
+        prepare_resume();
+        return resume_with(0);
+    }
+
+private:
+    explicit async_result(std::nullptr_t): base_t(nullptr) {}
+
+    int push(lua_State* L)
+    {
+        if (!m_state || m_state->has_value)
+            return 0;
+        return push_pending(L);
+    }
+};
+
+template <typename R>
+struct converter<async_result<R>>
+    : converter_base<converter<async_result<R>>> {
+
+    // May return detail::yield_results or detail::error_results, which only
+    // raw_function::caught() (used for all functions pushed by apollo)
+    // understands, so async_result can only be used as the return type of a
+    // function, not as part of another value.
+    static int push(lua_State* L, async_result<R> r)
+    {
+        return r.push(L);
+    }
+};
+
+} // namespace apollo
+
+#endif // APOLLO_ASYNC_RESULT_HPP_INCLUDED
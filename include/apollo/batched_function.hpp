@@ -0,0 +1,181 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef APOLLO_BATCHED_FUNCTION_HPP_INCLUDED
+#define APOLLO_BATCHED_FUNCTION_HPP_INCLUDED \
+    APOLLO_BATCHED_FUNCTION_HPP_INCLUDED
+
+// make_batched_function(f) pushes a Lua function that calls f once for each
+// element of its table arguments, inside a single call from Lua, and returns
+// the results in a new table.
+
+#include <apollo/error.hpp>
+#include <apollo/function_primitives.hpp>
+#include <apollo/gc.hpp>
+#include <apollo/make_function.hpp>
+#include <apollo/raw_function.hpp>
+
+#include <boost/exception/info.hpp>
+
+#include <string>
+
+namespace apollo {
+
+template <typename F>
+struct batched_function {
+    F f;
+};
+
+template <typename F>
+batched_function<detail::remove_cvr<F>> make_batched_function(F&& f)
+{
+    return {std::forward<F>(f)};
+}
+
+namespace detail {
+
+// Checks the arguments 1 to n_args of a batched call and returns the number of
+// calls, i.e. the common length of all table arguments.
+APOLLO_API int batch_size(lua_State* L, int n_args);
+
+template <typename F>
+struct batched_caller {
+    static int entry_point(lua_State* L)
+    {
+        return entry_point_impl(L, is_light_function<F>());
+    }
+
+private:
+    // Non-light function:
+    static int entry_point_impl(lua_State* L, std::false_type)
+    {
+        return call(L, *static_cast<F*>(
+            lua_touserdata(L, lua_upvalueindex(1))));
+    }
+
+    // Light function:
+    static int entry_point_impl(lua_State* L, std::true_type)
+    {
+        auto voidholder = lua_touserdata(L, lua_upvalueindex(1));
+        auto f = reinterpret_cast<light_function_holder<F>&>(voidholder).f;
+        return call(L, f);
+    }
+
+    static int call(lua_State* L, F& f)
+    {
+        auto converters = default_converters(f);
+        using converters_t = decltype(converters);
+        return call_batch(L, f, converters,
+            iseq_n_t<std::tuple_size<converters_t>::value - 1, 1>());
+    }
+
+    template <typename Converters, int... Is>
+    static int call_batch(
+        lua_State* L, F& f, Converters& converters, iseq<Is...>)
+    {
+        using rconverter_t = remove_cvr<decltype(std::get<0>(converters))>;
+        using is_void_t = std::is_void<to_type_of<rconverter_t>>;
+        int const n_args = sizeof...(Is);
+        lua_settop(L, n_args); // Missing arguments are nil, as for all calls.
+        int const n_calls = batch_size(L, n_args);
+
+        APOLLO_DETAIL_CONSTCOND_BEGIN
+        if (!is_void_t::value)
+        APOLLO_DETAIL_CONSTCOND_END
+            lua_createtable(L, n_calls, 0);
+        int const results = lua_gettop(L);
+        int const first = results + 1;
+        if (!lua_checkstack(L, n_args + LUA_MINSTACK)) {
+            BOOST_THROW_EXCEPTION(lua_api_error()
+                << errinfo::msg("stack overflow"));
+        }
+
+        for (int i = 1; i <= n_calls; ++i) {
+            for (int j = 1; j <= n_args; ++j) {
+                if (lua_type(L, j) == LUA_TTABLE)
+                    lua_rawgeti(L, j, i);
+                else
+                    lua_pushvalue(L, j);
+            }
+            int n_results;
+            try {
+                n_results = call_one(L, f, first, std::get<0>(converters),
+                    is_void_t(), std::get<Is>(converters)...);
+            } catch (to_cpp_conversion_error& e) {
+                // Report the argument of the batched call.
+                int const* idx =
+                    boost::get_error_info<errinfo::stack_index>(e);
+                if (idx && *idx >= first)
+                    e << errinfo::stack_index(*idx - first + 1);
+                e << errinfo::msg("conversion from Lua to C++ failed for "
+                    "batch element " + std::to_string(i));
+                throw;
+            }
+            APOLLO_DETAIL_CONSTCOND_BEGIN
+            if (!is_void_t::value) {
+            APOLLO_DETAIL_CONSTCOND_END
+                if (n_results != 1) // Store exactly one result.
+                    lua_settop(L, first + n_args);
+                lua_rawseti(L, results, i);
+            }
+            lua_settop(L, results);
+        }
+        return is_void_t::value ? 0 : 1;
+    }
+
+    // Returns the number of pushed results.
+    template <typename ResultConverter, typename... Converters>
+    static int call_one(
+        lua_State* L, F& f, int first, ResultConverter&, std::true_type,
+        Converters&... converters)
+    {
+        call_with_stack_args_impl(L, first, f,
+            iseq_n_t<sizeof...(Converters) - is_mem_fn<F>::value>(),
+            converters...);
+        return 0;
+    }
+
+    template <typename ResultConverter, typename... Converters>
+    static int call_one(
+        lua_State* L, F& f, int first, ResultConverter& rconverter,
+        std::false_type, Converters&... converters)
+    {
+        return rconverter.push(L, call_with_stack_args_impl(L, first, f,
+            iseq_n_t<sizeof...(Converters) - is_mem_fn<F>::value>(),
+            converters...));
+    }
+};
+
+} // namespace detail
+
+template <typename F>
+struct converter<batched_function<F>>
+    : converter_base<converter<batched_function<F>>> {
+
+    static int push(lua_State* L, batched_function<F> const& f)
+    {
+        push_impl(L, f.f, detail::is_light_function<F>());
+        lua_pushcclosure(L, raw_function::caught<
+            &detail::batched_caller<F>::entry_point>(), 1);
+        return 1;
+    }
+
+private:
+    // Nonlight function
+    static void push_impl(lua_State* L, F const& f, std::false_type)
+    {
+        push_gc_object(L, f);
+    }
+
+    // Light function
+    static void push_impl(lua_State* L, F const& f, std::true_type)
+    {
+        detail::light_function_holder<F> holder{f};
+        lua_pushlightuserdata(L, reinterpret_cast<void*&>(holder));
+    }
+};
+
+} // namespace apollo
+
+#endif // APOLLO_BATCHED_FUNCTION_HPP_INCLUDED
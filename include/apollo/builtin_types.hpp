@@ -9,6 +9,7 @@
 #include <apollo/converters.hpp>
 
 #include <boost/assert.hpp>
+#include <boost/utility/string_ref.hpp>
 
 #include <cstdint>
 #include <limits>
@@ -29,6 +30,8 @@ private:
         std::is_signed<T>::value == std::is_signed<lua_Integer>::value;
 
 public:
+    static BOOST_CONSTEXPR_OR_CONST bool is_type_determined = true;
+
     static int push(lua_State* L, T n)
     {
         APOLLO_DETAIL_CONSTCOND_BEGIN
@@ -129,6 +132,8 @@ struct converter<T,
         typename std::enable_if<std::is_enum<T>::value>::type
     >: converter_base<T> {
 
+    static BOOST_CONSTEXPR_OR_CONST bool is_type_determined = true;
+
     static int push(lua_State* L, T n)
     {
         lua_pushinteger(L, static_cast<lua_Integer>(n));
@@ -153,6 +158,8 @@ struct converter<T,
 template<>
 struct converter<bool>: converter_base<converter<bool>> {
 
+    static BOOST_CONSTEXPR_OR_CONST bool is_type_determined = true;
+
     static int push(lua_State* L, bool b)
     {
         lua_pushboolean(L, static_cast<int>(b));
@@ -181,6 +188,8 @@ struct converter<bool>: converter_base<converter<bool>> {
 // void converter //
 template<>
 struct converter<void>: converter_base<converter<void>> {
+    static BOOST_CONSTEXPR_OR_CONST bool is_type_determined = true;
+
     static unsigned n_conversion_steps(lua_State*, int)
     {
         return no_conversion - 1;
@@ -224,6 +233,18 @@ inline void push_string(lua_State* L, std::string const& s)
     lua_pushlstring(L, s.c_str(), s.size());
 }
 
+inline void push_string(lua_State* L, boost::string_ref s)
+{
+    lua_pushlstring(L, s.data(), s.size());
+}
+
+#ifdef APOLLO_HAS_STD_STRING_VIEW
+inline void push_string(lua_State* L, std::string_view s)
+{
+    lua_pushlstring(L, s.data(), s.size());
+}
+#endif
+
 template <typename T, typename Enable = void>
 struct to_string;
 
@@ -264,6 +285,48 @@ struct to_string<std::string> {
     }
 };
 
+template <typename T>
+struct is_string_ref: std::false_type {};
+
+template <>
+struct is_string_ref<boost::string_ref>: std::true_type {};
+
+#ifdef APOLLO_HAS_STD_STRING_VIEW
+template <>
+struct is_string_ref<std::string_view>: std::true_type {};
+#endif
+
+// Borrows the string from Lua instead of copying it: the result is only
+// valid as long as the value stays on the stack (e.g. during a call of a
+// function that takes it as argument). As for char const*, numbers on the
+// stack are converted to strings in place.
+template <typename StringRef>
+struct to_string_ref {
+    using type = StringRef;
+    static type to(lua_State* L, int idx)
+    {
+        std::size_t len;
+        char const* s = lua_tolstring(L, idx, &len);
+        return type(s, len);
+    }
+
+    static type safe_to(lua_State* L, int idx)
+    {
+        std::size_t len;
+        if (char const* s = lua_tolstring(L, idx, &len))
+            return type(s, len);
+        BOOST_THROW_EXCEPTION(to_cpp_conversion_error());
+    }
+};
+
+template <>
+struct to_string<boost::string_ref>: to_string_ref<boost::string_ref> {};
+
+#ifdef APOLLO_HAS_STD_STRING_VIEW
+template <>
+struct to_string<std::string_view>: to_string_ref<std::string_view> {};
+#endif
+
 template <>
 struct to_string<char> {
     using type = char;
@@ -296,6 +359,7 @@ template <typename T>
 struct string_conversion_steps<T, typename std::enable_if<
     std::is_convertible<T, char const*>::value
     || std::is_same<T, std::string>::value
+    || is_string_ref<T>::value
 >::type> {
     static unsigned get(lua_State* L, int idx)
     {
@@ -326,6 +390,9 @@ private:
     using dt = typename std::decay<T>::type;
 
 public:
+    // Conversion of numbers to char depends on their value.
+    static BOOST_CONSTEXPR_OR_CONST bool is_type_determined =
+        !std::is_same<dt, char>::value;
 
     static int push(lua_State* L, T const& s)
     {
@@ -351,6 +418,8 @@ public:
 
 template <>
 struct converter<void*>: converter_base<converter<void*>> {
+    static BOOST_CONSTEXPR_OR_CONST bool is_type_determined = true;
+
     static int push(lua_State* L, void* p)
     {
         lua_pushlightuserdata(L, p);
@@ -15,6 +15,8 @@
 #include <apollo/detail/light_key.hpp>
 #include <apollo/detail/ref_binder.hpp>
 
+#include <boost/type_traits/is_virtual_base_of.hpp>
+
 namespace apollo {
 
 namespace detail {
@@ -23,6 +25,48 @@ APOLLO_API void push_instance_metatable(
     lua_State* L,
     class_info const& cls) BOOST_NOEXCEPT;
 
+// Completes the header of the instance_udata at the top of the stack (the
+// holder-specific parts must already have been set by
+// Holder::init_header()), thereby marking it as an apollo instance, and sets
+// its metatable.
+APOLLO_API void init_instance_udata(
+    lua_State* L,
+    instance_holder* holder,
+    class_info const& cls) BOOST_NOEXCEPT;
+
+template <typename Holder, typename... Args>
+void emplace_instance(lua_State* L, class_info const& cls, Args&&... args)
+{
+    using udata_t = instance_udata<Holder>;
+    auto udata = static_cast<udata_t*>(lua_newuserdata(L, sizeof(udata_t)));
+    udata->header.tag = nullptr; // Not an instance until fully constructed.
+    try {
+        new(&udata->holder) Holder(std::forward<Args>(args)...);
+    } catch (...) {
+        lua_pop(L, 1);
+        throw;
+    }
+    udata->holder.init_header(udata->header);
+    init_instance_udata(L, &udata->holder, cls);
+}
+
+// Pushes the instance cached for obj in the identity cache of cls and returns
+// true, if there is one whose instance_holder has the type holder_type.
+// Otherwise, pushes nothing and returns false.
+APOLLO_API bool push_cached_instance(
+    lua_State* L,
+    class_info const& cls,
+    void const* obj,
+    boost::typeindex::type_info const& holder_type);
+
+// Stores the instance at the top of the stack as the one for obj in the
+// identity cache of cls.
+APOLLO_API void cache_instance(
+    lua_State* L, class_info const& cls, void const* obj);
+
+APOLLO_API void evict_cached_instance(
+    lua_State* L, class_info const& cls, void const* obj);
+
 template <typename Ptr>
 void push_instance_ptr(lua_State* L, Ptr&& ptr)
 {
@@ -30,11 +74,24 @@ void push_instance_ptr(lua_State* L, Ptr&& ptr)
     using holder_t = ptr_instance_holder<ptr_t>;
     using cls_t = remove_cvr<typename pointer_traits<ptr_t>::pointee_type>;
 
-    class_info const& cls = registered_class(L,
-        boost::typeindex::type_id<cls_t>().type_info());
-    emplace_bare_udata<holder_t>(L, std::forward<Ptr>(ptr), cls);
-    push_instance_metatable(L, cls);
-    lua_setmetatable(L, -2);
+    class_info const& cls = registered_class<cls_t>(L);
+    if (BOOST_LIKELY(!cls.cache_identity)) {
+        emplace_instance<holder_t>(L, cls, std::forward<Ptr>(ptr));
+        return;
+    }
+
+    using boost::get_pointer;
+    void const* const obj = get_pointer(ptr);
+    if (!obj) {
+        emplace_instance<holder_t>(L, cls, std::forward<Ptr>(ptr));
+        return;
+    }
+    if (push_cached_instance(
+            L, cls, obj, boost::typeindex::type_id<holder_t>().type_info())) {
+        return;
+    }
+    emplace_instance<holder_t>(L, cls, std::forward<Ptr>(ptr));
+    cache_instance(L, cls, obj);
 }
 
 template <typename T>
@@ -44,19 +101,96 @@ void push_instance_val(lua_State* L, T&& val)
     using holder_t = value_instance_holder<obj_t>;
 
     using cls_t = remove_cvr<obj_t>;
-    class_info const& cls = registered_class(L,
-        boost::typeindex::type_id<cls_t>().type_info());
-    emplace_bare_udata<holder_t>(L, std::forward<T>(val), cls);
-    push_instance_metatable(L, cls);
-    lua_setmetatable(L, -2);
+    class_info const& cls = registered_class<cls_t>(L);
+    emplace_instance<holder_t>(L, cls, std::forward<T>(val));
 }
 
+// Sets the member name of cls to the value at the top of the stack, which
+// is popped. See add_method().
+APOLLO_API void set_member(
+    lua_State* L, class_info const& cls, char const* name);
+
+APOLLO_API void set_property(
+    lua_State* L, class_info const& cls, char const* name,
+    lua_CFunction getter, lua_CFunction setter);
+
+APOLLO_API void set_indexer(
+    lua_State* L, class_info const& cls,
+    lua_CFunction getter, lua_CFunction setter);
+
+// Type codes of fields accessed by byte offset (see add_field()).
+enum class field_type: unsigned char {
+    none, // Not a field but a property with getter and setter functions.
+    bool_, char_, schar, uchar, short_, ushort, int_, uint, long_, ulong,
+    llong, ullong, float_, double_
+};
+
+template <typename T>
+struct field_type_of; // Not defined for unsupported types.
+
+#define APOLLO_DETAIL_FIELD_TYPE(t, code) \
+    template <> \
+    struct field_type_of<t> \
+        : std::integral_constant<field_type, field_type::code> {};
+
+APOLLO_DETAIL_FIELD_TYPE(bool, bool_)
+APOLLO_DETAIL_FIELD_TYPE(char, char_)
+APOLLO_DETAIL_FIELD_TYPE(signed char, schar)
+APOLLO_DETAIL_FIELD_TYPE(unsigned char, uchar)
+APOLLO_DETAIL_FIELD_TYPE(short, short_)
+APOLLO_DETAIL_FIELD_TYPE(unsigned short, ushort)
+APOLLO_DETAIL_FIELD_TYPE(int, int_)
+APOLLO_DETAIL_FIELD_TYPE(unsigned, uint)
+APOLLO_DETAIL_FIELD_TYPE(long, long_)
+APOLLO_DETAIL_FIELD_TYPE(unsigned long, ulong)
+APOLLO_DETAIL_FIELD_TYPE(long long, llong)
+APOLLO_DETAIL_FIELD_TYPE(unsigned long long, ullong)
+APOLLO_DETAIL_FIELD_TYPE(float, float_)
+APOLLO_DETAIL_FIELD_TYPE(double, double_)
+
+#undef APOLLO_DETAIL_FIELD_TYPE
+
+// Returns the offset of member in a C object. Since member can only refer to
+// a member of C itself or of a non-virtual base of C, this is the same for
+// all C objects and computing it needs no object of the dynamic type.
+template <typename C, typename M>
+std::size_t member_offset(M C::* member)
+{
+    typename std::aligned_storage<sizeof(C), alignof(C)>::type storage;
+    auto const obj = reinterpret_cast<C*>(&storage);
+    return static_cast<std::size_t>(
+        reinterpret_cast<char const volatile*>(&(obj->*member))
+        - reinterpret_cast<char const volatile*>(obj));
+}
+
+// Returns the offset of the (non-virtual) base class subobject C in T,
+// computed like the base offsets in make_class_info_impl().
+template <typename T, typename C>
+std::size_t base_subobject_offset()
+{
+    return static_cast<std::size_t>(
+        reinterpret_cast<char*>(static_cast<C*>(reinterpret_cast<T*>(1)))
+        - reinterpret_cast<char*>(1));
+}
+
+// base_offset is the offset of the subobject declaring the field in cls,
+// offset that of the field in this subobject.
+APOLLO_API void set_field(
+    lua_State* L, class_info const& cls, char const* name, field_type type,
+    std::size_t base_offset, std::size_t offset, bool is_read_only);
+
 APOLLO_API bool is_apollo_instance(lua_State* L, int idx);
 
-inline instance_holder* as_holder(lua_State* L, int idx)
+inline instance_header* as_header(lua_State* L, int idx)
 {
     BOOST_ASSERT(lua_isnil(L, idx) || is_apollo_instance(L, idx));
-    return static_cast<instance_holder*>(lua_touserdata(L, idx));
+    return static_cast<instance_header*>(lua_touserdata(L, idx));
+}
+
+inline instance_holder* as_holder(lua_State* L, int idx)
+{
+    auto header = as_header(L, idx);
+    return header ? header->holder : nullptr;
 }
 
 
@@ -71,11 +205,14 @@ template <typename T>
 struct object_converter<T const&, typename std::enable_if<
         !detail::pointer_traits<T>::is_valid
     >::type>: converter_base<converter<T const&>, ref_binder<T const>> {
+    // Implicit constructors are looked up by ltypeid() which is determined
+    // by the Lua type, or the class for instances.
+    static BOOST_CONSTEXPR_OR_CONST bool is_type_determined = true;
+
 private:
     static implicit_ctor* get_ctor_opt(lua_State* L, int idx)
     {
-        auto const& cls = registered_class(L,
-            boost::typeindex::type_id<T>().type_info());
+        auto const& cls = registered_class<T>(L);
         auto const& ctors = cls.implicit_ctors;
         auto i_ctor = ctors.find(ltypeid(L, idx));
         return i_ctor == ctors.end() ? nullptr : i_ctor->second.get();
@@ -129,6 +266,7 @@ struct object_converter<T&, typename std::enable_if<
         && !std::is_const<T>::value
     >::type>: converter_base<converter<T&>> {
 public:
+    static BOOST_CONSTEXPR_OR_CONST bool is_type_determined = true;
 
     static unsigned n_conversion_steps(lua_State* L, int idx)
     {
@@ -177,6 +315,8 @@ private:
     }
 
 public:
+    static BOOST_CONSTEXPR_OR_CONST bool is_type_determined = true;
+
     static unsigned n_conversion_steps(lua_State* L, int idx)
     {
         APOLLO_DETAIL_CONSTCOND_BEGIN
@@ -198,7 +338,7 @@ public:
             return make_nil_smart_ptr(is_ref());
 
         return static_cast<ptr_instance_holder<ptr_t>*>(
-            lua_touserdata(L, idx))->get_outer_ptr();
+            as_holder(L, idx))->get_outer_ptr();
     }
 
     static Ptr safe_to(lua_State* L, int idx)
@@ -215,7 +355,7 @@ public:
                         " are not supported)."));
             }
             return static_cast<ptr_instance_holder<ptr_t>*>(
-                lua_touserdata(L, idx))->get_outer_ptr();
+                holder)->get_outer_ptr();
         }
 
         if (lua_isnil(L, idx))
@@ -236,6 +376,8 @@ private:
     using pointee_t = typename ptr_traits::pointee_type;
     using obj_t = remove_cvr<pointee_t>;
 public:
+    static BOOST_CONSTEXPR_OR_CONST bool is_type_determined = true;
+
     static unsigned n_conversion_steps(lua_State* L, int idx)
     {
         if (lua_isnil(L, idx))
@@ -243,23 +385,23 @@ public:
         if (!is_apollo_instance(L, idx))
             return no_conversion;
 
-        auto holder = as_holder(L, idx);
+        auto const& header = *as_header(L, idx);
 
-        if (!is_const_correct(holder))
+        if (!is_const_correct(header))
             return no_conversion;
 
         return n_class_conversion_steps(
-            holder->type(), static_class_id<obj_t>::id);
+            *header.cls, static_class_id<obj_t>::id);
     }
 
     static Ptr to(lua_State* L, int idx)
     {
-        auto holder = as_holder(L, idx);
-        if (!holder) // This means not a userdata, so assume nil.
+        auto header = as_header(L, idx);
+        if (!header) // This means not a userdata, so assume nil.
             return nullptr;
         return static_cast<Ptr>(cast_class(
-            holder->get(),
-            holder->type(),
+            instance_object(*header),
+            *header->cls,
             static_class_id<obj_t>::id));
     }
 
@@ -279,15 +421,15 @@ public:
     {
         err = nullptr;
         if (BOOST_LIKELY(is_apollo_instance(L, idx))) {
-            auto holder = as_holder(L, idx);
-            if (!is_const_correct(holder)) {
+            auto const& header = *as_header(L, idx);
+            if (!is_const_correct(header)) {
                 err = "Class conversion loses const.";
                 return nullptr;
             }
 
             return static_cast<Ptr>(try_cast_class(
-                holder->get(),
-                holder->type(),
+                instance_object(header),
+                *header.cls,
                 static_class_id<obj_t>::id,
                 err));
         }
@@ -300,11 +442,11 @@ public:
     }
 
 private:
-    static bool is_const_correct(instance_holder const* holder)
+    static bool is_const_correct(instance_header const& header)
     {
-        // MSVC complains that holder is unused if ptr_traits::is_const is true.
-        (void)holder;
-        return ptr_traits::is_const || !holder->is_const();
+        // MSVC complains that header is unused if ptr_traits::is_const is true.
+        (void)header;
+        return ptr_traits::is_const || !header.is_const;
     }
 };
 
@@ -324,12 +466,9 @@ void emplace_object(lua_State* L, Args&&... args)
     using holder_t = detail::value_instance_holder<obj_t>;
     using cls_t = detail::remove_cvr<obj_t>;
 
-    detail::class_info const& cls = detail::registered_class(L,
-        boost::typeindex::type_id<cls_t>().type_info());
-    emplace_bare_udata<holder_t>(L, cls, std::forward<Args>(args)...);
-    detail::push_instance_metatable(L, cls);
-    lua_setmetatable(L, -2);
-
+    detail::class_info const& cls = detail::registered_class<cls_t>(L);
+    detail::emplace_instance<holder_t>(
+        L, cls, std::forward<Args>(args)...);
 }
 
 
@@ -344,22 +483,164 @@ template <typename T>
 void push_class_metatable(lua_State* L)
 {
     using obj_t = detail::remove_cvr<T>;
-    detail::push_instance_metatable(L, detail::registered_class(L,
-        boost::typeindex::type_id<obj_t>().type_info()));
+    detail::push_instance_metatable(L, detail::registered_class<obj_t>(L));
 }
 
 template <typename T, typename... Bases>
 void register_class(lua_State* L)
 {
     auto& registry = detail::registered_classes(L);
-    auto index = boost::typeindex::type_id<T>();
-    if (registry.find(index) != registry.end()) {
-        BOOST_ASSERT_MSG(false, "Class already registered!");
-    }
-    registry.insert(std::make_pair(
-        index, detail::make_class_info<T, Bases...>(registry)));
+    registry.insert(detail::make_class_info<T, Bases...>(registry));
 }
 
+// Makes pushing the same (raw or smart) pointer to a T multiple times result
+// in the same userdata, as long as the userdata is alive. Instances are only
+// reused if they hold the same pointer type (so e.g. pushing a T* after a
+// T const* creates a new instance). If the object is destroyed while an
+// instance referencing it may still be cached, call evict_cached_instance(),
+// otherwise a new object at the same address would get the old instance.
+template <typename T>
+void enable_identity_cache(lua_State* L)
+{
+    auto& cls = detail::registered_class<detail::remove_cvr<T>>(L);
+    BOOST_ASSERT_MSG(!cls.is_frozen,
+        "Use shared_class_registry::enable_identity_cache() instead.");
+    cls.cache_identity = true;
+}
+
+// Makes f (which is pushed using push()) available as obj.name, and thus
+// obj:name(...), for instances of T and classes derived from T.
+//
+// Members are resolved by __index and __newindex functions that apollo sets
+// in the metatable of T (which must not have a custom __index then) using a
+// per-class table that also contains all members of base classes. It is
+// built when the class's metatable is created; members added to a base class
+// later are copied into the tables of existing derived classes, unless a
+// derived class has a member with the same name.
+template <typename T, typename F>
+void add_method(lua_State* L, char const* name, F&& f)
+{
+    push(L, std::forward<F>(f));
+    detail::set_member(
+        L, detail::registered_class<detail::remove_cvr<T>>(L), name);
+}
+
+// Makes reading obj.name result in getter(obj) and assigning v to it in
+// setter(obj, v) for instances of T and derived classes. Either function may
+// be nullptr for write- or read-only properties. They are called directly
+// from the __index/__newindex functions (see add_method()), so use e.g.
+// APOLLO_TO_RAW_FUNCTION(APOLLO_MEMBER_GETTER(T::m)).
+template <typename T>
+void add_property(
+    lua_State* L, char const* name,
+    lua_CFunction getter, lua_CFunction setter = nullptr)
+{
+    detail::set_property(
+        L, detail::registered_class<detail::remove_cvr<T>>(L), name,
+        getter, setter);
+}
+
+// Like add_property() with the getter and setter generated by
+// APOLLO_MEMBER_GETTER and APOLLO_MEMBER_SETTER, but only records the byte
+// offset and type of member: reading and writing is done by one function per
+// field type, which saves the overhead of calling converted functions. Only
+// members of builtin arithmetic types (and bool) are supported. Const members
+// are always read-only.
+template <typename T, typename C, typename M>
+void add_field(
+    lua_State* L, char const* name, M C::* member, bool is_read_only = false)
+{
+    using cls_t = detail::remove_cvr<T>;
+    static_assert(std::is_base_of<C, cls_t>::value,
+        "add_field: member is not a member of T.");
+    // The offset of a virtual base depends on the dynamic type of the object.
+    static_assert(!boost::is_virtual_base_of<C, cls_t>::value,
+        "add_field: members of virtual bases are not supported; use "
+        "add_property() instead.");
+    detail::set_field(
+        L, detail::registered_class<cls_t>(L), name,
+        detail::field_type_of<typename std::remove_cv<M>::type>::value,
+        detail::base_subobject_offset<cls_t, C>(),
+        detail::member_offset(member),
+        is_read_only || std::is_const<M>::value);
+    // If you get an error about field_type_of being incomplete here, M is not
+    // supported by add_field(); use add_property() instead.
+}
+
+// Makes reading obj[key] call getter(obj, key) and assigning v to it call
+// setter(obj, key, v) for all keys that are not strings (string keys are
+// still looked up as members). Either function may be nullptr. Like
+// properties, indexers are inherited by derived classes.
+template <typename T>
+void add_indexer(
+    lua_State* L, lua_CFunction getter, lua_CFunction setter = nullptr)
+{
+    detail::set_indexer(
+        L, detail::registered_class<detail::remove_cvr<T>>(L),
+        getter, setter);
+}
+
+// Removes the instance cached for obj (if any) from the identity cache, so
+// that the next push of obj creates a new one. Existing references to the old
+// instance are not affected.
+template <typename T>
+void evict_cached_instance(lua_State* L, T const* obj)
+{
+    detail::evict_cached_instance(
+        L, detail::registered_class<detail::remove_cvr<T>>(L), obj);
+}
+
+
+// A set of classes that is registered once and can then be attached to any
+// number of lua_States, which is much cheaper than calling register_class()
+// for each of them. The classes must be fully set up before freeze() is
+// called; afterwards, attach() may be called from multiple threads
+// concurrently. Only metatables (and identity caches) are created per state.
+// Copies refer to the same classes.
+class shared_class_registry {
+public:
+    shared_class_registry()
+        : m_registry(std::make_shared<detail::class_registry>())
+    {}
+
+    template <typename T, typename... Bases>
+    void register_class()
+    {
+        m_registry->insert(detail::make_class_info<T, Bases...>(*m_registry));
+    }
+
+    template <typename T>
+    void enable_identity_cache()
+    {
+        detail_class<T>().cache_identity = true;
+    }
+
+    void freeze() { m_registry->freeze(); }
+    bool is_frozen() const { return m_registry->is_frozen(); }
+
+    // Makes the classes available in L. Asserts that this registry is frozen
+    // and that none of its classes was registered in L before. Classes may
+    // still be registered in L afterwards (also derived from attached ones).
+    void attach(lua_State* L) const
+    {
+        detail::registered_classes(L).attach(m_registry);
+    }
+
+    // For use by other apollo functions, e.g. add_implicit_ctor().
+    template <typename T>
+    detail::class_info& detail_class()
+    {
+        auto cls = m_registry->find(
+            detail::static_class_id<detail::remove_cvr<T>>::id);
+        BOOST_ASSERT_MSG(cls, "Use of unregistered class.");
+        BOOST_ASSERT_MSG(!cls->is_frozen, "Registry is already frozen.");
+        return *cls;
+    }
+
+private:
+    std::shared_ptr<detail::class_registry> m_registry;
+};
+
 
 // Userdata converters //
 
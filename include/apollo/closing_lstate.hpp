@@ -6,6 +6,7 @@
 #define APOLLO_CLOSING_LSTATE_HPP_INCLUDED
 
 #include <apollo/lua_include.hpp>
+#include <apollo/memory_pool.hpp>
 
 namespace apollo {
 
@@ -15,6 +16,9 @@ public:
 
     closing_lstate(): m_L(luaL_newstate()) {}
 
+    // pool must outlive the closing_lstate.
+    explicit closing_lstate(memory_pool& pool): m_L(pool.new_state()) {}
+
     closing_lstate(closing_lstate&& other)
         : m_L(other.m_L)
     {
@@ -43,6 +43,25 @@
 #   define APOLLO_NO_WSTRING
 #endif
 
+// Older Boost versions (before the BOOST_NO_CXX17_HDR_* macros existed) do not
+// tell whether C++17 headers are available, so the language version is
+// checked too.
+#ifdef _MSVC_LANG
+#   define APOLLO_DETAIL_CPLUSPLUS _MSVC_LANG
+#else
+#   define APOLLO_DETAIL_CPLUSPLUS __cplusplus
+#endif
+
+#if APOLLO_DETAIL_CPLUSPLUS >= 201703L \
+    && !defined(BOOST_NO_CXX17_HDR_STRING_VIEW)
+#   define APOLLO_HAS_STD_STRING_VIEW
+#endif
+
+#if APOLLO_DETAIL_CPLUSPLUS >= 201703L \
+    && !defined(BOOST_NO_CXX17_HDR_OPTIONAL)
+#   define APOLLO_HAS_STD_OPTIONAL
+#endif
+
 #ifdef BOOST_MSVC
 #   define APOLLO_DETAIL_PUSHMSWARN(id) \
         __pragma(warning(push))         \
@@ -14,9 +14,13 @@
 #include <boost/exception/info.hpp>
 #include <boost/throw_exception.hpp>
 #include <boost/type_index.hpp>
+#include <boost/utility/string_ref_fwd.hpp>
 #include <apollo/lua_include.hpp>
 
 #include <type_traits>
+#ifdef APOLLO_HAS_STD_STRING_VIEW
+#   include <string_view>
+#endif
 
 namespace apollo {
 
@@ -56,6 +60,10 @@ template <> struct lua_type_id<char const*>: lua_type_id<char*> {};
 template <> struct lua_type_id<char>: lua_type_id<char*> {};
 template <std::size_t N> struct lua_type_id<char[N]>: lua_type_id<char*> {};
 template <> struct lua_type_id<std::string>: lua_type_id<char*> {};
+template <> struct lua_type_id<boost::string_ref>: lua_type_id<char*> {};
+#ifdef APOLLO_HAS_STD_STRING_VIEW
+template <> struct lua_type_id<std::string_view>: lua_type_id<char*> {};
+#endif
 
 // wide string
 #ifndef APOLLO_NO_WSTRING
@@ -53,6 +53,13 @@ public:
 
     static BOOST_CONSTEXPR_OR_CONST int n_consumed = 1;
 
+    // True if the result of n_conversion_steps() depends only on the Lua type
+    // of the value and on the properties recorded in overload resolution
+    // caches (integer or numeric string for numbers and strings; class,
+    // constness, holder type and nullness for apollo instances). Overload
+    // sets cache their resolution only if this holds for all parameters.
+    static BOOST_CONSTEXPR_OR_CONST bool is_type_determined = false;
+
     to_type idx_to(lua_State* L, int idx, int* next_idx) const
     {
         advance_idx(idx, next_idx);
@@ -91,6 +91,30 @@ public:
         return std::move(*this);
     }
 
+    // Members (see add_method(), add_property() and add_field()) //
+
+    template<typename F>
+    class_creator&& method(char const* name, F&& f)
+    {
+        add_method<T>(this->m_L, name, std::forward<F>(f));
+        return std::move(*this);
+    }
+
+    class_creator&& property(
+        char const* name, lua_CFunction getter, lua_CFunction setter = nullptr)
+    {
+        add_property<T>(this->m_L, name, getter, setter);
+        return std::move(*this);
+    }
+
+    template<typename C, typename M>
+    class_creator&& field(
+        char const* name, M C::* member, bool is_read_only = false)
+    {
+        add_field<T>(this->m_L, name, member, is_read_only);
+        return std::move(*this);
+    }
+
     // Misc //
 
     typename std::add_rvalue_reference<Parent>::type end_cls()
@@ -6,6 +6,7 @@
 #define APOLLO_CLASS_INFO_HPP_INCLUDED APOLLO_CLASS_INFO_HPP_INCLUDED
 
 #include <apollo/config.hpp>
+#include <apollo/detail/light_key.hpp>
 #include <apollo/detail/variadic_pass.hpp>
 
 #include <boost/assert.hpp>
@@ -62,15 +63,23 @@ struct class_info {
         boost::typeindex::type_info const* rtti_type_, std::size_t static_id_)
         : rtti_type(rtti_type_)
         , static_id(static_id_)
+        , cache_identity(false)
+        , is_frozen(false)
     { }
 
-    // Contains all casts, including indirect bases.
     struct base_relation {
+        std::size_t static_id;
         std::ptrdiff_t offset;
         unsigned n_intermediate_bases;
     };
 
-    std::unordered_map<std::size_t, base_relation> bases;
+    // Returns nullptr if static_id is not a (direct or indirect) base.
+    APOLLO_API base_relation const* find_base(std::size_t static_id) const;
+
+    // Contains all casts, including indirect bases, sorted by static_id.
+    // Hierarchies are usually shallow, so a flat array is both smaller and
+    // faster to search than a hash table.
+    std::vector<base_relation> bases;
 
     boost::typeindex::type_info const* rtti_type;
 
@@ -81,12 +90,74 @@ struct class_info {
     > implicit_ctors;
 
     std::size_t static_id;
+
+    // See enable_identity_cache().
+    bool cache_identity;
+    // True if the class is part of a frozen (and thus shareable) registry.
+    bool is_frozen;
+    // Registry key of the weak table mapping object addresses to instances.
+    light_key identity_cache_key;
+    // Registry keys of the table of the members added to this class and of
+    // the member table that also contains the inherited ones (see
+    // add_method()).
+    light_key own_member_table_key;
+    light_key member_table_key;
 };
 
-using class_info_map = std::unordered_map<
-    boost::typeindex::type_index,
-    class_info,
-    boost::hash<boost::typeindex::type_index>>;
+// Per-state table of all registered classes. Lookups are done by
+// static_class_id, which is dense, so that resolving the class_info of an
+// object being pushed is a plain array index instead of a hash lookup.
+//
+// A frozen registry can additionally be shared by any number of states (see
+// shared_class_registry in class.hpp): its classes are then attached to the
+// per-state registries by pointer.
+class class_registry {
+public:
+    class_info* find(std::size_t static_id) const
+    {
+        return static_id < m_classes.size() ? m_classes[static_id] : nullptr;
+    }
+
+    // Asserts that no class with the same static_id was inserted or attached
+    // before and that the registry is not frozen.
+    APOLLO_API class_info& insert(class_info&& cls);
+
+    // Makes all classes of the frozen registry shared available in this one,
+    // keeping shared alive as long as this registry exists. Asserts that no
+    // class is contained in both.
+    APOLLO_API void attach(std::shared_ptr<class_registry const> shared);
+
+    // Afterwards, insert() must not be called any more and the class_infos
+    // of this registry must not be modified (which is asserted where
+    // possible), so that it can be used from multiple threads.
+    APOLLO_API void freeze();
+
+    bool is_frozen() const { return m_frozen; }
+
+    std::size_t size() const { return m_size; }
+
+    // Calls f(cls) for each class_info& cls in this registry.
+    template <typename F>
+    void for_each(F&& f) const
+    {
+        for (class_info* cls: m_classes) {
+            if (cls)
+                f(*cls);
+        }
+    }
+
+private:
+    // Indexed by static_id; contains both owned and attached classes.
+    std::vector<class_info*> m_classes;
+
+    // Owning pointers so that class_info addresses stay valid (they are used
+    // e.g. as registry keys for metatables).
+    std::vector<std::unique_ptr<class_info>> m_owned;
+
+    std::vector<std::shared_ptr<class_registry const>> m_attached;
+    std::size_t m_size = 0;
+    bool m_frozen = false;
+};
 
 APOLLO_API void* cast_class(
     void* obj, class_info const& cls, std::size_t to);
@@ -95,13 +166,26 @@ APOLLO_API void* try_cast_class(
 APOLLO_API unsigned n_class_conversion_steps(
     class_info const& from, std::size_t to);
 
-APOLLO_API class_info_map& registered_classes(lua_State* L);
-APOLLO_API class_info* registered_class_opt(
-    lua_State* L, boost::typeindex::type_info const& type);
+APOLLO_API class_registry& registered_classes(lua_State* L);
+
+inline class_info* registered_class_opt(lua_State* L, std::size_t static_id)
+{
+    return registered_classes(L).find(static_id);
+}
 
 // Only assert()s that the class is registered.
-APOLLO_API class_info& registered_class(
-    lua_State* L, boost::typeindex::type_info const& type);
+inline class_info& registered_class(lua_State* L, std::size_t static_id)
+{
+    auto cls = registered_class_opt(L, static_id);
+    BOOST_ASSERT_MSG(cls, "Use of unregistered class.");
+    return *cls;
+}
+
+template <typename T>
+class_info& registered_class(lua_State* L)
+{
+    return registered_class(L, static_class_id<T>::id);
+}
 
 struct base_info {
     class_info const* type;
@@ -111,7 +195,7 @@ struct base_info {
 template <typename Derived, typename Base>
 int add_base_helper(
     std::vector<base_info>& bases,
-    class_info_map const& base_infos)
+    class_registry const& base_infos)
 {
     static_assert(std::is_base_of<Base, Derived>::value,
         "register_class: Base is no base of Derived");
@@ -119,10 +203,9 @@ int add_base_helper(
     // argument of register_class<T, Bases...>() that is not really a base of T.
 
     base_info binfo;
-    auto i_bcinfo = base_infos.find(boost::typeindex::type_id<Base>());
-    BOOST_ASSERT_MSG(i_bcinfo != base_infos.end(),
+    binfo.type = base_infos.find(static_class_id<Base>::id);
+    BOOST_ASSERT_MSG(binfo.type,
                         "Base classes must be registered before derived ones.");
-    binfo.type = &i_bcinfo->second;
     binfo.cast = &cast_static<Derived, Base>;
     bases.push_back(std::move(binfo));
     return int();
@@ -134,7 +217,7 @@ APOLLO_API class_info make_class_info_impl(
     std::vector<base_info>& bases);
 
 template <typename T, typename... Bases>
-class_info make_class_info(class_info_map const& base_infos)
+class_info make_class_info(class_registry const& base_infos)
 {
     (void)base_infos; // Avoid MSVC warning when Bases is empty.
     std::vector<base_info> bases;
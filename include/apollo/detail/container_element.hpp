@@ -0,0 +1,67 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef APOLLO_CONTAINER_ELEMENT_HPP_INCLUDED
+#define APOLLO_CONTAINER_ELEMENT_HPP_INCLUDED \
+    APOLLO_CONTAINER_ELEMENT_HPP_INCLUDED
+
+#include <apollo/builtin_types.hpp>
+
+namespace apollo {
+
+namespace detail {
+
+// Strings borrowed from the Lua stack (see to_string_ref). Numbers are
+// converted to new strings in the stack slot, so they must not outlive the
+// conversion of the element in containers.
+template <typename T>
+struct is_borrowed_string: std::integral_constant<bool,
+    std::is_convertible<T, char const*>::value || is_string_ref<T>::value> {};
+
+// Element access for arbitrary element types: uses the default converters.
+template <typename T, typename Enable = void>
+struct container_element {
+    static unsigned n_conversion_steps(lua_State* L, int idx)
+    {
+        return apollo::n_conversion_steps<T>(L, idx);
+    }
+
+    static T to(lua_State* L, int idx)
+    {
+        return unwrap_ref(unchecked_to<T>(L, idx));
+    }
+
+    static T safe_to(lua_State* L, int idx)
+    {
+        return unwrap_ref(apollo::to<T>(L, idx));
+    }
+};
+
+// Fast path for numbers and booleans: their converters are used directly,
+// without the stack index handling and reference wrapping of the generic
+// functions.
+template <typename T>
+struct container_element<T, typename std::enable_if<
+        std::is_arithmetic<T>::value>::type> {
+    static unsigned n_conversion_steps(lua_State* L, int idx)
+    {
+        return converter<T>::n_conversion_steps(L, idx);
+    }
+
+    static T to(lua_State* L, int idx)
+    {
+        return converter<T>::to(L, idx);
+    }
+
+    static T safe_to(lua_State* L, int idx)
+    {
+        return converter<T>().safe_to(L, idx);
+    }
+};
+
+} // namespace detail
+
+} // namespace apollo
+
+#endif // APOLLO_CONTAINER_ELEMENT_HPP_INCLUDED
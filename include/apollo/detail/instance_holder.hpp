@@ -7,106 +7,138 @@
 
 #include <apollo/detail/smart_ptr.hpp>
 
+#include <boost/config.hpp>
 #include <boost/get_pointer.hpp>
 
+#include <memory>
+#include <type_traits>
+
 namespace apollo { namespace detail {
 
 struct class_info;
 
+// Only used to destroy the held object (or pointer) when the instance is
+// garbage collected; everything else is read from the instance_header.
 class instance_holder {
 public:
     virtual ~instance_holder() {}
-    virtual void* get() = 0; // Get a pointer to the instance.
-    virtual class_info const& type() const = 0; // The instance's class.
-    virtual bool is_const() const = 0;
+};
+
+enum class instance_kind: unsigned char {
+    value, // value_instance_holder
+    raw_ptr, // ptr_instance_holder for plain pointers
+    smart_ptr // ptr_instance_holder for all other pointers
+};
+
+// The userdata block of every apollo instance starts with an instance_header,
+// which allows identifying instances without looking at their metatable and
+// accessing them without virtual calls.
+struct instance_header {
+    void const* tag; // Points to the (private) object tag for instances.
+    instance_holder* holder; // Points into the same userdata block.
+    class_info const* cls; // The instance's class.
+
+    // Points to the instance, or, for instance_kind::smart_ptr, to the smart
+    // pointer (which may change or be reset while the instance exists).
+    void* object;
+    // For instance_kind::smart_ptr: Returns the pointer held by the smart
+    // pointer passed as argument.
+    void* (*get_smart_ptr)(void* smart_ptr);
+
+    bool is_const;
+    instance_kind kind;
+};
+
+// Returns a pointer to the instance (which may be nullptr for pointers).
+inline void* instance_object(instance_header const& header)
+{
+    return BOOST_LIKELY(header.kind != instance_kind::smart_ptr) ?
+        header.object : header.get_smart_ptr(header.object);
+}
+
+// Memory layout of the userdata of instances held by a Holder.
+template <typename Holder>
+struct instance_udata {
+    instance_header header;
+    Holder holder;
 };
 
 template <typename T>
 class value_instance_holder: public instance_holder {
 public:
+    // Emplaces, copies or moves the value.
     template <typename... Args>
-    value_instance_holder(class_info const& cls, Args&&... args) // Emplace val
+    explicit value_instance_holder(Args&&... args)
         : m_instance(std::forward<Args>(args)...)
-        , m_type(&cls)
     {}
 
-
-    value_instance_holder(T&& val, class_info const& cls) // Move val
-        : m_instance(std::move(val))
-        , m_type(&cls)
-    {}
-
-    value_instance_holder(T const& val, class_info const& cls) // Copy val
-        : m_instance(val)
-        , m_type(&cls)
-    {}
-
-    // Silence MSVC C4512: Assignment operator could not be generated.
+    value_instance_holder(value_instance_holder const&) = delete;
     value_instance_holder& operator= (value_instance_holder const&) = delete;
 
-    void* get() override
+    // Precondition: header.holder == this
+    void init_header(instance_header& header)
     {
-        return const_cast<void*>(
+        header.object = const_cast<void*>(
             static_cast<void const*>(std::addressof(m_instance)));
-    }
-
-    bool is_const() const override
-    {
-        return std::is_const<T>::value;
-    }
-
-    class_info const& type() const override
-    {
-        return *m_type;
+        header.get_smart_ptr = nullptr;
+        header.is_const = std::is_const<T>::value;
+        header.kind = instance_kind::value;
     }
 
 private:
     T m_instance;
-    class_info const* m_type;
 };
 
 template <typename Ptr>
 class ptr_instance_holder: public instance_holder {
     using ptr_traits = pointer_traits<Ptr>;
 public:
-    ptr_instance_holder(Ptr&& ptr, class_info const& cls) // Move ptr
+    explicit ptr_instance_holder(Ptr&& ptr) // Move ptr
         : m_instance(std::move(ptr))
-        , m_type(&cls)
     {}
 
-    ptr_instance_holder(Ptr const& ptr, class_info const& cls) // Copy ptr
+    explicit ptr_instance_holder(Ptr const& ptr) // Copy ptr
         : m_instance(ptr)
-        , m_type(&cls)
     {}
 
     ptr_instance_holder(ptr_instance_holder&&) = delete;
 
-    void* get() override
+    // Precondition: header.holder == this
+    void init_header(instance_header& header)
     {
-        using boost::get_pointer;
-        return const_cast<void*>(
-            static_cast<void const*>(get_pointer(m_instance)));
+        init_header_impl(header, std::is_pointer<Ptr>());
+        header.is_const = ptr_traits::is_const;
+    }
 
+    Ptr& get_outer_ptr()
+    {
+        return m_instance;
     }
 
-    bool is_const() const override
+private:
+    static void* get_smart_ptr(void* smart_ptr)
     {
-        return ptr_traits::is_const;
+        using boost::get_pointer;
+        return const_cast<void*>(static_cast<void const*>(
+            get_pointer(*static_cast<Ptr*>(smart_ptr))));
     }
 
-    class_info const& type() const override
+    void init_header_impl(instance_header& header, std::true_type)
     {
-        return *m_type;
+        header.object = const_cast<void*>(
+            static_cast<void const*>(m_instance));
+        header.get_smart_ptr = nullptr;
+        header.kind = instance_kind::raw_ptr;
     }
 
-    Ptr& get_outer_ptr()
+    void init_header_impl(instance_header& header, std::false_type)
     {
-        return m_instance;
+        header.object = std::addressof(m_instance);
+        header.get_smart_ptr = &get_smart_ptr;
+        header.kind = instance_kind::smart_ptr;
     }
 
-private:
     Ptr m_instance;
-    class_info const* m_type;
 };
 
 } } // namespace apollo::detail
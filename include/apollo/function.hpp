@@ -7,12 +7,16 @@
 
 #include <apollo/config.hpp>
 #include <apollo/lapi.hpp>
+#include <apollo/lua_callable.hpp>
 #include <apollo/make_function.hpp>
 #include <apollo/reference.hpp>
 #include <apollo/stack_balance.hpp>
 
+#include <boost/function.hpp>
 #include <boost/type_index.hpp>
 
+#include <functional>
+
 namespace apollo {
 
 namespace detail {
@@ -32,42 +36,42 @@ struct function_converter<FObj<R(Args...)>> {
     static type to(lua_State* L, int idx)
     {
         auto const& fty = function_type(L, idx);
-        if (fty == boost::typeindex::type_id<type>()) {
-            stack_balance balance(L);
-            BOOST_VERIFY(lua_getupvalue(L, idx, detail::fn_upval_fn));
-            BOOST_ASSERT(lua_type(L, -1) == LUA_TUSERDATA); // Not light!
-            return *static_cast<type*>(lua_touserdata(L, -1));
-        }
+        if (fty == boost::typeindex::type_id<type>())
+            return pushed_object<type>(L, idx);
 
         // Plain function pointer in Lua? Then construct from it.
         using plainfconv = function_converter<R(*)(Args...)>;
         if (fty == boost::typeindex::type_id<typename plainfconv::type>())
             return plainfconv::to(L, idx);
 
-        // TODO?: optimization: Before falling back to the pcall lambda,
-        // try boost::function and std::function.
-
-        registry_reference luaFunction(L, idx, ref_mode::copy);
-        return [luaFunction](Args... args) -> R {
-            lua_State* L_ = luaFunction.L();
-            stack_balance b(L_);
-            int const oldtop = lua_gettop(L_);
-            luaFunction.push();
-            int const n_args = push_impl(L_, std::forward<Args>(args)...);
-            pcall(L_, n_args, LUA_MULTRET);
-            return apollo::to<R>(L_, oldtop + 1);
-        };
+        // Another function object type with the same signature? Then wrap it
+        // instead of calling it through Lua.
+        using std_fn_t = std::function<R(Args...)>;
+        if (fty == boost::typeindex::type_id<std_fn_t>())
+            return type(pushed_object<std_fn_t>(L, idx));
+        using boost_fn_t = boost::function<R(Args...)>;
+        if (fty == boost::typeindex::type_id<boost_fn_t>())
+            return type(pushed_object<boost_fn_t>(L, idx));
+
+        return type(lua_callable<R(Args...)>(L, idx));
     }
 
     static unsigned n_conversion_steps(lua_State* L, int idx)
     {
-        if (lua_isfunction(L, idx))
-            return 0;
-        if (luaL_getmetafield(L, idx, "__call")) { // TODO: pcall
-            lua_pop(L, 1);
-            return 2;
-        }
-        return no_conversion;
+        return callable_conversion_steps(L, idx);
+    }
+
+private:
+    // The function object stored in the upvalue of the function at idx,
+    // which must have been pushed as a T.
+    template <typename T>
+    static T const& pushed_object(lua_State* L, int idx)
+    {
+        stack_balance balance(L);
+        BOOST_VERIFY(lua_getupvalue(L, idx, detail::fn_upval_fn));
+        BOOST_ASSERT(lua_type(L, -1) == LUA_TUSERDATA); // Not light!
+        // The function at idx keeps the userdata alive after popping it.
+        return *static_cast<T const*>(lua_touserdata(L, -1));
     }
 };
 
@@ -115,7 +119,8 @@ private:
 // Function converter //
 template<typename T>
 struct converter<T, typename std::enable_if<
-        detail::lua_type_id<T>::value == LUA_TFUNCTION>::type>
+        detail::lua_type_id<T>::value == LUA_TFUNCTION &&
+        !detail::is_lua_callable<T>::value>::type>
     : converter_base<converter<T>> {
 
 private:
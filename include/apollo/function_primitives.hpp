@@ -88,30 +88,29 @@ default_converters(R(C::*)(Args...) const)
 }
 
 
-// Plain function pointer or function object:
+// Plain function pointer or function object, arguments starting at i0:
 template <typename F, int... Is, typename... Converters>
 typename std::enable_if<!is_mem_fn<F>::value, return_type_of<F>>::type
 call_with_stack_args_impl(
-    lua_State* L, F&& f, iseq<Is...>, Converters&&... convs)
+    lua_State* L, int i0, F&& f, iseq<Is...>, Converters&&... convs)
 {
-    auto args = to_tuple(L, 1, std::forward<Converters>(convs)...);
+    auto args = to_tuple(L, i0, std::forward<Converters>(convs)...);
     static_assert(std::tuple_size<decltype(args)>::value == sizeof...(Is), "");
     return f(unwrap_ref(std::get<Is>(args))...);
 }
 
-// (Const) member function pointer:
+// (Const) member function pointer, instance at i0:
 template <
     typename ThisConverter, typename... Converters, int... Is, typename F>
 typename std::enable_if<is_mem_fn<F>::value, return_type_of<F>>::type
 call_with_stack_args_impl(
-    lua_State* L, F&& f,
+    lua_State* L, int i0, F&& f,
     iseq<Is...>,
     ThisConverter&& this_conv,
     Converters&&... convs
 )
 {
-    int i0;
-    to_type_of<ThisConverter> instance = to_with(this_conv, L, 1, &i0);
+    to_type_of<ThisConverter> instance = to_with(this_conv, L, i0, &i0);
     auto args = to_tuple(L, i0, std::forward<Converters>(convs)...);
     (void)args; // Silence gcc's -Wunused-but-set-variable
     return (unwrap_ref(instance).*f)(unwrap_ref(std::get<Is>(args))...);
@@ -126,7 +125,7 @@ detail::return_type_of<F> call_with_stack_args_with(
     auto arg_seq = detail::iseq_n_t
         <sizeof...(Converters) - detail::is_mem_fn<F>::value>();
     return detail::call_with_stack_args_impl(
-        L, std::forward<F>(f),
+        L, 1, std::forward<F>(f),
         arg_seq,
         std::forward<Converters>(converters)...);
 }
@@ -5,6 +5,7 @@
 #ifndef APOLLO_GC_HPP_INCLUDED
 #define APOLLO_GC_HPP_INCLUDED APOLLO_GC_HPP_INCLUDED
 
+#include <apollo/detail/light_key.hpp>
 #include <apollo/detail/meta_util.hpp>
 
 #include <boost/assert.hpp>
@@ -47,6 +48,20 @@ push_bare_udata(lua_State* L, T&& o)
 
 
 
+namespace detail {
+
+// Registry key of the metatable shared by all objects pushed with
+// push_gc_object<T>().
+template <typename T>
+struct gc_metatable_key {
+    static light_key key;
+};
+
+template <typename T>
+light_key gc_metatable_key<T>::key;
+
+} // namespace detail
+
 // Note: __gc will not unset metatable.
 // Use for objects that cannot be retrieved from untrusted Lua code only.
 template <typename T>
@@ -58,9 +73,16 @@ push_gc_object(lua_State* L, T&& o)
     APOLLO_DETAIL_CONSTCOND_BEGIN
     if (!std::is_trivially_destructible<obj_t>::value) {
     APOLLO_DETAIL_CONSTCOND_END
-        lua_createtable(L, 0, 1); // 0 sequence entries, 1 dictionary entry
-        lua_pushcfunction(L, &gc_object<obj_t>);
-        lua_setfield(L, -2, "__gc");
+        void* key = detail::gc_metatable_key<obj_t>::key;
+        lua_rawgetp(L, LUA_REGISTRYINDEX, key);
+        if (BOOST_UNLIKELY(lua_isnil(L, -1))) {
+            lua_pop(L, 1);
+            lua_createtable(L, 0, 1); // 0 sequence entries, 1 dict. entry
+            lua_pushcfunction(L, &gc_object<obj_t>);
+            lua_setfield(L, -2, "__gc");
+            lua_pushvalue(L, -1);
+            lua_rawsetp(L, LUA_REGISTRYINDEX, key);
+        }
         lua_setmetatable(L, -2);
     }
     return static_cast<obj_t*>(uf);
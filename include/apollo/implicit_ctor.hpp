@@ -6,6 +6,8 @@
 #define APOLLO_IMPLICIT_CTOR_HPP_INCLUDED APOLLO_IMPLICIT_CTOR_HPP_INCLUDED
 
 #include <apollo/class.hpp>
+#include <apollo/overload.hpp>
+#include <apollo/detail/signature.hpp>
 
 namespace apollo {
 
@@ -43,27 +45,43 @@ private:
     Ctor m_ctor;
 };
 
-} // namespace detail
-
 template <typename From, typename To>
-void add_implicit_ctor(lua_State* L, To(*ctor)(From))
+void add_implicit_ctor_to(class_info& cls, To(*ctor)(From))
 {
-    auto const& to_tid = boost::typeindex::type_id<
-        typename std::remove_pointer<detail::remove_cvr<
-            To>>::type>().type_info();
-    auto const ltype = detail::lua_type_id<From>::value;
+    auto const ltype = lua_type_id<From>::value;
     auto const& from_tid = ltype == LUA_TUSERDATA ?
-        boost::typeindex::type_id<detail::remove_cvr<From>>().type_info() :
+        boost::typeindex::type_id<remove_cvr<From>>().type_info() :
         lbuiltin_typeid(ltype);
     using ctor_f_t = decltype(ctor);
-    using ctor_impl_t = detail::implicit_ctor_impl<ctor_f_t>;
-    auto& cls = detail::registered_class(L, to_tid);
+    using ctor_impl_t = implicit_ctor_impl<ctor_f_t>;
     std::unique_ptr<ctor_impl_t> ctor_impl(new ctor_impl_t(ctor));
     BOOST_VERIFY_MSG(
         cls.implicit_ctors.emplace(
             boost::typeindex::type_index(from_tid),
             std::move(ctor_impl)).second,
         "A ctor with From -> To already exists.");
+    invalidate_overload_caches();
+}
+
+template <typename To>
+using implicit_ctor_cls = typename std::remove_pointer<remove_cvr<To>>::type;
+
+} // namespace detail
+
+template <typename From, typename To>
+void add_implicit_ctor(lua_State* L, To(*ctor)(From))
+{
+    auto& cls = detail::registered_class<detail::implicit_ctor_cls<To>>(L);
+    BOOST_ASSERT_MSG(!cls.is_frozen,
+        "Add implicit ctors to the shared_class_registry instead.");
+    detail::add_implicit_ctor_to(cls, ctor);
+}
+
+template <typename From, typename To>
+void add_implicit_ctor(shared_class_registry& classes, To(*ctor)(From))
+{
+    detail::add_implicit_ctor_to(
+        classes.detail_class<detail::implicit_ctor_cls<To>>(), ctor);
 }
 
 } // namespace apollo
@@ -7,6 +7,8 @@
 
 #include <apollo/lua_include.hpp>
 
+#include <boost/config.hpp>
+
 namespace apollo {
 
 APOLLO_API void set_error_msg_handler(lua_State* L);
@@ -15,6 +17,14 @@ APOLLO_API bool push_error_msg_handler(lua_State* L);
 APOLLO_API void pcall(lua_State* L, int nargs, int nresults, int msgh);
 APOLLO_API void pcall(lua_State* L, int nargs, int nresults);
 
+namespace detail {
+
+// Pops the error message and throws the lua_api_error that pcall() throws
+// for the lua_pcall() error code r.
+APOLLO_API BOOST_NORETURN void throw_pcall_error(lua_State* L, int r);
+
+} // namespace detail
+
 // for k, v in pairs(with) do t[k] = v end, but uses rawset and next.
 // Error reporting: lua_error
 APOLLO_API void extend_table(lua_State* L, int t, int with);
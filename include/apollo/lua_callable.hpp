@@ -0,0 +1,163 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef APOLLO_LUA_CALLABLE_HPP_INCLUDED
+#define APOLLO_LUA_CALLABLE_HPP_INCLUDED APOLLO_LUA_CALLABLE_HPP_INCLUDED
+
+#include <apollo/converters.hpp>
+#include <apollo/lapi.hpp>
+#include <apollo/reference.hpp>
+#include <apollo/stack_balance.hpp>
+
+#include <cstddef>
+#include <type_traits>
+
+namespace apollo {
+
+template <typename Signature>
+class lua_callable;
+
+namespace detail {
+
+template <typename T>
+struct is_lua_callable: std::false_type {};
+
+template <typename Signature>
+struct is_lua_callable<lua_callable<Signature>>: std::true_type {};
+
+template <typename R>
+struct lua_callable_result {
+    static BOOST_CONSTEXPR_OR_CONST int n_results =
+        pull_converter_for<R>::n_consumed;
+
+    using out_ptr = R*;
+
+    static R to(lua_State* L, int idx)
+    {
+        return apollo::to<R>(L, idx);
+    }
+
+    static void store(lua_State* L, int idx, R* out)
+    {
+        if (out)
+            *out = apollo::to<R>(L, idx);
+    }
+};
+
+template <>
+struct lua_callable_result<void> {
+    static BOOST_CONSTEXPR_OR_CONST int n_results = 0;
+
+    using out_ptr = std::nullptr_t;
+
+    static void to(lua_State*, int) {}
+    static void store(lua_State*, int, std::nullptr_t) {}
+};
+
+// Lua functions and values with a __call metamethod can be called.
+inline unsigned callable_conversion_steps(lua_State* L, int idx)
+{
+    if (lua_isfunction(L, idx))
+        return 0;
+    if (luaL_getmetafield(L, idx, "__call")) { // TODO: pcall
+        lua_pop(L, 1);
+        return 2;
+    }
+    return no_conversion;
+}
+
+} // namespace detail
+
+// A reference to a Lua function (or callable value) that can be called like
+// a C++ function of the given signature. The error message handler (see
+// set_error_msg_handler()) is looked up once, on construction, and is kept
+// referenced together with the function, so that calling only needs to push
+// both and the arguments before lua_pcall().
+template <typename R, typename... Args>
+class lua_callable<R(Args...)> {
+    using result = detail::lua_callable_result<R>;
+
+public:
+    lua_callable() {}
+
+    lua_callable(lua_State* L, int idx)
+        : m_fn(L, idx, ref_mode::copy)
+    {
+        if (push_error_msg_handler(L))
+            m_msgh.reset(L, -1, ref_mode::move);
+    }
+
+    // Throws lua_api_error (like pcall()) if the function raises an error.
+    R operator() (Args... args) const
+    {
+        lua_State* const L = m_fn.L();
+        stack_balance balance(L);
+        int const r = call(std::forward<Args>(args)...);
+        if (r != LUA_OK)
+            detail::throw_pcall_error(L, r);
+        return result::to(L, -result::n_results);
+    }
+
+    // Like operator(), but returns the error code of lua_pcall() instead of
+    // throwing if the function raises an error. The error message is
+    // discarded; install a message handler to log it. On success, the return
+    // value is assigned to *out, unless out is null (for R = void, pass
+    // nullptr). Failing to convert the return value still throws.
+    int try_call(typename result::out_ptr out, Args... args) const
+    {
+        lua_State* const L = m_fn.L();
+        stack_balance balance(L);
+        int const r = call(std::forward<Args>(args)...);
+        if (r == LUA_OK)
+            result::store(L, -result::n_results, out);
+        return r;
+    }
+
+    bool empty() const { return m_fn.empty(); }
+    lua_State* L() const { return m_fn.L(); }
+    registry_reference const& function() const { return m_fn; }
+
+private:
+    int call(Args&&... args) const
+    {
+        lua_State* const L = m_fn.L();
+        int msgh = 0;
+        if (!m_msgh.empty()) {
+            m_msgh.push();
+            msgh = lua_gettop(L);
+        }
+        m_fn.push();
+        int const n_args = detail::push_impl(L, std::forward<Args>(args)...);
+        return lua_pcall(L, n_args, result::n_results, msgh);
+    }
+
+    registry_reference m_fn;
+    registry_reference m_msgh;
+};
+
+template <typename R, typename... Args>
+struct converter<lua_callable<R(Args...)>>
+    : converter_base<converter<lua_callable<R(Args...)>>> {
+
+    using type = lua_callable<R(Args...)>;
+
+    static int push(lua_State* L, type const& f)
+    {
+        return apollo::push(L, f.function());
+    }
+
+    static unsigned n_conversion_steps(lua_State* L, int idx)
+    {
+        return detail::callable_conversion_steps(L, idx);
+    }
+
+    static type to(lua_State* L, int idx)
+    {
+        return type(L, idx);
+    }
+};
+
+} // namespace apollo
+
+#endif // APOLLO_LUA_CALLABLE_HPP_INCLUDED
@@ -11,17 +11,22 @@
 #include <apollo/gc.hpp>
 #include <apollo/raw_function.hpp>
 
+#include <boost/type_index.hpp>
+
 namespace apollo {
 
 namespace detail {
 
-APOLLO_API void push_function_tag(lua_State* L);
+// Records that closures of entry_point are apollo functions, whose type
+// function_type() reads from their fn_upval_type upvalue. Returns
+// entry_point.
+APOLLO_API lua_CFunction register_function_entry_point(
+    lua_CFunction entry_point);
 
 int const
     fn_upval_fn = 1,
-    fn_upval_tag = 2,
-    fn_upval_type = 3,
-    fn_upval_converters = 4;
+    fn_upval_type = 2,
+    fn_upval_converters = 3;
 
 template <typename F>
 struct light_function_holder {
@@ -245,20 +250,22 @@ public:
 
     static int push(lua_State* L, type&& f)
     {
+        static lua_CFunction const entry_point =
+            detail::register_function_entry_point(
+                raw_function::caught<&type::entry_point>());
+
         push_impl(L, std::move(f.fn()), detail::is_light_function<F>());
         static_assert(detail::fn_upval_fn == 1, "");
-        detail::push_function_tag(L);
-        static_assert(detail::fn_upval_tag == 2, "");
         lua_pushlightuserdata(L, const_cast<boost::typeindex::type_info*>(
             &boost::typeindex::type_id<F>().type_info()));
-        static_assert(detail::fn_upval_type == 3, "");
+        static_assert(detail::fn_upval_type == 2, "");
 
-        int nups = 3;
-        static_assert(detail::fn_upval_converters == 4, "");
+        int nups = 2;
+        static_assert(detail::fn_upval_converters == 3, "");
         if (type::dispatch_t::push_converters(L, std::move(f.converters)))
             ++nups;
 
-        lua_pushcclosure(L, raw_function::caught<&type::entry_point>(), nups);
+        lua_pushcclosure(L, entry_point, nups);
         return 1;
     }
 
@@ -0,0 +1,280 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef APOLLO_MAP_CONVERTERS_HPP_INCLUDED
+#define APOLLO_MAP_CONVERTERS_HPP_INCLUDED APOLLO_MAP_CONVERTERS_HPP_INCLUDED
+
+// Converters between Lua tables and std::map, std::unordered_map and
+// boost::container::flat_map, and visit_table() for consuming a table entry
+// by entry.
+
+#include <apollo/detail/container_element.hpp>
+#include <apollo/stack_balance.hpp>
+
+#include <boost/container/flat_map.hpp>
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace apollo {
+
+namespace detail {
+
+template <typename K, typename V, typename C, typename A>
+struct lua_type_id<std::map<K, V, C, A>>
+    : std::integral_constant<int, LUA_TTABLE> {};
+
+template <typename K, typename V, typename H, typename E, typename A>
+struct lua_type_id<std::unordered_map<K, V, H, E, A>>
+    : std::integral_constant<int, LUA_TTABLE> {};
+
+template <typename K, typename V, typename C, typename A>
+struct lua_type_id<boost::container::flat_map<K, V, C, A>>
+    : std::integral_constant<int, LUA_TTABLE> {};
+
+// Number of entries of the table at idx (which must be absolute).
+inline std::size_t count_table_entries(lua_State* L, int idx)
+{
+    std::size_t n = 0;
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+        ++n;
+        lua_pop(L, 1);
+    }
+    return n;
+}
+
+// Collects the entries of a map. If needs_size is true, the number of entries
+// is counted before the builder is created, so that it can reserve memory.
+template <typename Map>
+class map_builder {
+public:
+    static bool const needs_size = false;
+
+    explicit map_builder(std::size_t) {}
+
+    template <typename K, typename V>
+    void insert(K&& k, V&& v)
+    {
+        m_map.emplace(std::forward<K>(k), std::forward<V>(v));
+    }
+
+    Map finish() { return std::move(m_map); }
+
+private:
+    Map m_map;
+};
+
+template <typename K, typename V, typename H, typename E, typename A>
+class map_builder<std::unordered_map<K, V, H, E, A>> {
+public:
+    static bool const needs_size = true;
+
+    // Reserving the buckets avoids rehashing while filling the map.
+    explicit map_builder(std::size_t size) { m_map.reserve(size); }
+
+    template <typename K2, typename V2>
+    void insert(K2&& k, V2&& v)
+    {
+        m_map.emplace(std::forward<K2>(k), std::forward<V2>(v));
+    }
+
+    std::unordered_map<K, V, H, E, A> finish() { return std::move(m_map); }
+
+private:
+    std::unordered_map<K, V, H, E, A> m_map;
+};
+
+// Inserting into a flat_map in the unsorted order of lua_next() would move
+// half of its elements each time. Instead, all entries are collected, sorted
+// once and then inserted at the end.
+template <typename K, typename V, typename C, typename A>
+class map_builder<boost::container::flat_map<K, V, C, A>> {
+    using map_t = boost::container::flat_map<K, V, C, A>;
+    using entry_t = std::pair<K, V>;
+
+public:
+    static bool const needs_size = true;
+
+    explicit map_builder(std::size_t size) { m_entries.reserve(size); }
+
+    template <typename K2, typename V2>
+    void insert(K2&& k, V2&& v)
+    {
+        m_entries.emplace_back(std::forward<K2>(k), std::forward<V2>(v));
+    }
+
+    map_t finish()
+    {
+        map_t result;
+        auto const comp = result.key_comp();
+        std::stable_sort(m_entries.begin(), m_entries.end(),
+            [&comp](entry_t const& lhs, entry_t const& rhs) {
+                return comp(lhs.first, rhs.first);
+            });
+        // Different Lua keys can be converted to the same C++ key (e.g. 1 and
+        // "1" to std::string).
+        auto const end = std::unique(m_entries.begin(), m_entries.end(),
+            [&comp](entry_t const& lhs, entry_t const& rhs) {
+                return !comp(lhs.first, rhs.first);
+            });
+        result.reserve(static_cast<std::size_t>(end - m_entries.begin()));
+        result.insert(boost::container::ordered_unique_range,
+            std::make_move_iterator(m_entries.begin()),
+            std::make_move_iterator(end));
+        return result;
+    }
+
+private:
+    std::vector<entry_t> m_entries;
+};
+
+template <typename Map>
+struct map_converter: converter_base<converter<Map>> {
+private:
+    using key_t = typename Map::key_type;
+    using mapped_t = typename Map::mapped_type;
+    using key = container_element<key_t>;
+    using mapped = container_element<mapped_t>;
+    static_assert(
+        !is_borrowed_string<key_t>::value
+        && !is_borrowed_string<mapped_t>::value,
+        "Maps cannot hold strings borrowed from Lua; use std::string.");
+
+public:
+    static int push(lua_State* L, Map const& map)
+    {
+        // Presize the hash part, so that filling it never rehashes.
+        lua_createtable(L, 0, static_cast<int>(map.size()));
+        for (auto const& entry: map) {
+            push_converter_for<key_t>().push(L, entry.first);
+            push_converter_for<mapped_t>().push(L, entry.second);
+            lua_rawset(L, -3);
+        }
+        return 1;
+    }
+
+    // The maximum of the keys' and values' conversion steps, or no_conversion
+    // if any of them is not convertible.
+    static unsigned n_conversion_steps(lua_State* L, int idx)
+    {
+        if (!lua_istable(L, idx))
+            return no_conversion;
+        idx = lua_absindex(L, idx);
+        unsigned n_steps = 0;
+        lua_pushnil(L);
+        while (lua_next(L, idx)) {
+            unsigned const n_entry_steps = (std::max)(
+                key::n_conversion_steps(L, -2),
+                mapped::n_conversion_steps(L, -1));
+            if (n_entry_steps == no_conversion) {
+                lua_pop(L, 2);
+                return no_conversion;
+            }
+            if (n_entry_steps > n_steps)
+                n_steps = n_entry_steps;
+            lua_pop(L, 1);
+        }
+        return n_steps;
+    }
+
+    static Map to(lua_State* L, int idx)
+    {
+        return to_impl<&key::to, &mapped::to>(L, idx);
+    }
+
+    // Checks and converts each entry in a single pass.
+    static Map safe_to(lua_State* L, int idx)
+    {
+        if (!lua_istable(L, idx))
+            BOOST_THROW_EXCEPTION(to_cpp_conversion_error());
+        return to_impl<&key::safe_to, &mapped::safe_to>(L, idx);
+    }
+
+private:
+    template <
+        key_t (*ToKey)(lua_State*, int),
+        mapped_t (*ToMapped)(lua_State*, int)>
+    static Map to_impl(lua_State* L, int idx)
+    {
+        idx = lua_absindex(L, idx);
+        stack_balance balance(L);
+        map_builder<Map> builder(map_builder<Map>::needs_size ?
+            count_table_entries(L, idx) : 0);
+        lua_pushnil(L);
+        while (lua_next(L, idx)) {
+            // Converting a copy of the key, because converting a number key
+            // to a string in place would confuse lua_next().
+            lua_pushvalue(L, -2);
+            builder.insert(ToKey(L, -1), ToMapped(L, -2));
+            lua_pop(L, 2);
+        }
+        return builder.finish();
+    }
+};
+
+template <typename F, typename K, typename V>
+bool call_visitor(F& f, K&& k, V&& v, std::true_type /* returns void */)
+{
+    f(std::forward<K>(k), std::forward<V>(v));
+    return true;
+}
+
+template <typename F, typename K, typename V>
+bool call_visitor(F& f, K&& k, V&& v, std::false_type /* returns void */)
+{
+    return f(std::forward<K>(k), std::forward<V>(v)) ? true : false;
+}
+
+} // namespace detail
+
+template <typename K, typename V, typename C, typename A>
+struct converter<std::map<K, V, C, A>>
+    : detail::map_converter<std::map<K, V, C, A>> {};
+
+template <typename K, typename V, typename H, typename E, typename A>
+struct converter<std::unordered_map<K, V, H, E, A>>
+    : detail::map_converter<std::unordered_map<K, V, H, E, A>> {};
+
+template <typename K, typename V, typename C, typename A>
+struct converter<boost::container::flat_map<K, V, C, A>>
+    : detail::map_converter<boost::container::flat_map<K, V, C, A>> {};
+
+// Calls f(K, V) for each entry of the table at idx, without building a
+// container. Iteration stops early if f returns false (f may also return
+// void). Throws to_cpp_conversion_error if idx is not a table or an entry is
+// not convertible; f has already been called for the entries before it then.
+// K and V may borrow strings from Lua (e.g. boost::string_ref), but these are
+// only valid during the call of f.
+template <typename K, typename V, typename F>
+void visit_table(lua_State* L, int idx, F&& f)
+{
+    if (!lua_istable(L, idx)) {
+        BOOST_THROW_EXCEPTION(to_cpp_conversion_error()
+            << errinfo::msg("table expected"));
+    }
+    using key = detail::container_element<K>;
+    using mapped = detail::container_element<V>;
+    using returns_void = std::is_void<decltype(
+        f(std::declval<K>(), std::declval<V>()))>;
+
+    idx = lua_absindex(L, idx);
+    stack_balance balance(L);
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+        lua_pushvalue(L, -2); // See detail::map_converter::to_impl().
+        bool const go_on = detail::call_visitor(f,
+            key::safe_to(L, -1), mapped::safe_to(L, -2), returns_void());
+        lua_pop(L, 2);
+        if (!go_on)
+            break;
+    }
+}
+
+} // namespace apollo
+
+#endif // APOLLO_MAP_CONVERTERS_HPP_INCLUDED
@@ -0,0 +1,89 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef APOLLO_MEMORY_POOL_HPP_INCLUDED
+#define APOLLO_MEMORY_POOL_HPP_INCLUDED APOLLO_MEMORY_POOL_HPP_INCLUDED
+
+#include <apollo/config.hpp>
+#include <apollo/lua_include.hpp>
+
+#include <array>
+#include <cstddef>
+
+namespace apollo {
+
+// A lua_Alloc implementation for a single lua_State. Small blocks are served
+// from per-size-class free lists that are refilled from larger chunks; bigger
+// ones are forwarded to std::realloc(). Memory of chunks is only returned to
+// the system when the pool is destroyed, which must not happen before the
+// lua_State using it has been closed.
+class memory_pool {
+public:
+    // Blocks up to this size are pooled.
+    static std::size_t const max_pooled_size = 256;
+    // Pooled block sizes are multiples of this (which is also their alignment).
+    static std::size_t const granularity = 16;
+
+    // If max_bytes is not 0, allocations that would make n_bytes() exceed it
+    // fail (and Lua raises a memory error).
+    APOLLO_API explicit memory_pool(std::size_t max_bytes = 0);
+    APOLLO_API ~memory_pool();
+
+    memory_pool(memory_pool const&) = delete;
+    memory_pool& operator= (memory_pool const&) = delete;
+
+    // The lua_Alloc function; ud must point to a memory_pool.
+    APOLLO_API static void* lua_alloc(
+        void* ud, void* ptr, std::size_t osize, std::size_t nsize)
+        BOOST_NOEXCEPT;
+
+    // Like luaL_newstate() but using this pool. Returns nullptr on failure.
+    APOLLO_API lua_State* new_state();
+
+    // Bytes currently allocated by Lua (not counting unused pooled blocks).
+    std::size_t n_bytes() const { return m_n_bytes; }
+
+    // Number of blocks currently allocated by Lua.
+    std::size_t n_blocks() const { return m_n_blocks; }
+
+    // Number of chunks pooled blocks were taken from so far.
+    std::size_t n_chunks() const { return m_n_chunks; }
+
+    std::size_t max_bytes() const { return m_max_bytes; }
+    void set_max_bytes(std::size_t max_bytes) { m_max_bytes = max_bytes; }
+
+    // Allocates the chunks pooled blocks are taken from (std::malloc() by
+    // default), e.g. to test the handling of allocation failures. The memory
+    // is released with std::free(); nullptr results make the allocation fail.
+    using chunk_allocator = void* (*)(std::size_t size);
+    void set_chunk_allocator(chunk_allocator alloc) { m_chunk_alloc = alloc; }
+
+private:
+    struct free_block { free_block* next; };
+    struct chunk { chunk* next; };
+
+    static std::size_t const n_size_classes = max_pooled_size / granularity;
+
+    void* allocate(std::size_t size) BOOST_NOEXCEPT;
+    void deallocate(void* p, std::size_t size) BOOST_NOEXCEPT;
+    void* reallocate(void* p, std::size_t osize, std::size_t nsize)
+        BOOST_NOEXCEPT;
+    bool refill(std::size_t size_class) BOOST_NOEXCEPT;
+    bool is_chunk_block(void const* p) const BOOST_NOEXCEPT;
+
+    std::array<free_block*, n_size_classes> m_free_lists;
+    chunk* m_chunks;
+    std::size_t m_n_bytes;
+    std::size_t m_n_blocks;
+    std::size_t m_n_chunks;
+    // Blocks of pooled sizes that were allocated with std::malloc() (see
+    // reallocate()).
+    std::size_t m_n_foreign_blocks;
+    std::size_t m_max_bytes;
+    chunk_allocator m_chunk_alloc;
+};
+
+} // namespace apollo
+
+#endif // APOLLO_MEMORY_POOL_HPP_INCLUDED
@@ -0,0 +1,95 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef APOLLO_OPTIONAL_CONVERTERS_HPP_INCLUDED
+#define APOLLO_OPTIONAL_CONVERTERS_HPP_INCLUDED \
+    APOLLO_OPTIONAL_CONVERTERS_HPP_INCLUDED
+
+// Converters for boost::optional<T> and (when compiling as C++17)
+// std::optional<T>: nil (and none, i.e. a missing argument) is an empty
+// optional, anything else is converted to T.
+
+#include <apollo/converters.hpp>
+#include <apollo/detail/ref_binder.hpp>
+
+#include <boost/optional/optional.hpp>
+
+#ifdef APOLLO_HAS_STD_OPTIONAL
+#   include <optional>
+#endif
+
+namespace apollo {
+
+template <typename T>
+struct convert_cref_by_val<boost::optional<T>>: std::true_type {};
+
+#ifdef APOLLO_HAS_STD_OPTIONAL
+template <typename T>
+struct convert_cref_by_val<std::optional<T>>: std::true_type {};
+#endif
+
+namespace detail {
+
+template <typename Optional, typename T>
+struct optional_converter: converter_base<converter<Optional>> {
+private:
+    using value_converter = pull_converter_for<T>;
+    static_assert(value_converter::n_consumed == 1,
+        "optional: values consuming multiple stack slots are not supported.");
+
+public:
+    static BOOST_CONSTEXPR_OR_CONST bool is_type_determined =
+        value_converter::is_type_determined;
+
+    static int push(lua_State* L, Optional const& opt)
+    {
+        if (!opt) {
+            lua_pushnil(L);
+            return 1;
+        }
+        return push_converter_for<T>().push(L, *opt);
+    }
+
+    // nil is an exact match; values require one step more than converting
+    // them to T, so that overloads taking a T are preferred.
+    static unsigned n_conversion_steps(lua_State* L, int idx)
+    {
+        if (lua_isnoneornil(L, idx))
+            return 0;
+        return add_conversion_step(
+            apollo::n_conversion_steps<T>(L, idx));
+    }
+
+    static Optional to(lua_State* L, int idx)
+    {
+        if (lua_isnoneornil(L, idx))
+            return Optional();
+        return Optional(unwrap_ref(unchecked_to<T>(L, idx)));
+    }
+
+    // Does not check n_conversion_steps() first: nil is handled here and
+    // other values are checked by the value converter's safe_to().
+    static Optional safe_to(lua_State* L, int idx)
+    {
+        if (lua_isnoneornil(L, idx))
+            return Optional();
+        return Optional(unwrap_ref(apollo::to<T>(L, idx)));
+    }
+};
+
+} // namespace detail
+
+template <typename T>
+struct converter<boost::optional<T>>
+    : detail::optional_converter<boost::optional<T>, T> {};
+
+#ifdef APOLLO_HAS_STD_OPTIONAL
+template <typename T>
+struct converter<std::optional<T>>
+    : detail::optional_converter<std::optional<T>, T> {};
+#endif
+
+} // namespace apollo
+
+#endif // APOLLO_OPTIONAL_CONVERTERS_HPP_INCLUDED
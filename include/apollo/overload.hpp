@@ -12,6 +12,7 @@
 #include <boost/type_index.hpp>
 
 //#include <iostream>
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -20,37 +21,92 @@ namespace apollo {
 namespace detail {
 
 struct overload_quality {
-    std::vector<unsigned> param_conversion_steps;
+    // Points to an array of n_params elements (owned by the caller of
+    // overload_base::calculate_quality()).
+    unsigned const* param_conversion_steps;
+    std::size_t n_params;
     int n_lua_args_consumed;
 };
 
+// Adds the viable overload idx to the n_best indices (into qualities) in best
+// if it is better than one of them or not worse than any of them. If it is
+// better than all of them, it replaces them. Returns the new number of best
+// overloads; best must have room for one more element.
+APOLLO_API std::size_t update_best_overloads(
+    overload_quality const* qualities,
+    std::size_t* best, std::size_t n_best,
+    std::size_t idx);
+
+// Pushes the error message for a call of a static overload set (see
+// static_overload.hpp) for which no (n_candidates == 0) or more than one
+// overload was selected.
+APOLLO_API void push_static_overload_error(
+    lua_State* L, void (* const* push_signatures)(lua_State*),
+    std::size_t n_overloads,
+    std::size_t const* candidates, std::size_t n_candidates);
+
 class overload_base {
 public:
     virtual ~overload_base() {}
-    virtual overload_quality calculate_quality(lua_State* L) = 0;
+
+    // Number of C++ parameters.
+    virtual std::size_t arity() const = 0;
+
+    // Stores the conversion steps of each parameter in
+    // param_conversion_steps, which must have room for arity() elements, and
+    // returns the number of Lua arguments consumed. Parameters after the first
+    // one that is not convertible are set to no_conversion.
+    virtual int calculate_quality(
+        lua_State* L, unsigned* param_conversion_steps) = 0;
+
+    // True if all parameter converters are type determined (see
+    // converter_base::is_type_determined), i.e. the overload resolution
+    // result may be cached.
+    virtual bool is_type_determined() const = 0;
+
     virtual int invoke(lua_State* L) = 0;
     virtual void push_signature(lua_State* L) = 0; // For error messages.
 };
 
+template <typename ConverterTuple>
+struct arg_converters_type_determined;
+
+template <typename ResultConverter, typename... ArgConverters>
+struct arg_converters_type_determined<
+        std::tuple<ResultConverter, ArgConverters...>>
+    : bool_and<ArgConverters::is_type_determined...> {};
+
 template <typename ConvertedF>
 class overload: public overload_base {
+    using tuple_size_t = typename std::tuple_size<
+        typename ConvertedF::tuple_t>::type;
 public:
     template <typename FArg>
     explicit overload(FArg&& f):
         m_f(std::forward<FArg>(f))
     {}
 
-    overload_quality calculate_quality(lua_State* L) override
+    std::size_t arity() const override
+    {
+        return tuple_size_t::value - 1; // 0: result converter
+    }
+
+    int calculate_quality(
+        lua_State* L, unsigned* param_conversion_steps) override
     {
-        using tuple_size_t = typename std::tuple_size<
-            typename ConvertedF::tuple_t>::type;
-        std::vector<unsigned> result(tuple_size_t::value - 1, no_conversion);
+        std::fill_n(param_conversion_steps, arity(), no_conversion);
         int lidx = 1;
         param_conversion_steps_impl(
-            L, result, lidx,
+            L, param_conversion_steps, lidx,
             std::integral_constant<std::size_t, 1>(), // 0: result converter
             tuple_size_t());
-        return {std::move(result), lidx - 1};
+        return lidx - 1;
+    }
+
+    bool is_type_determined() const override
+    {
+        return arg_converters_type_determined<
+            typename ConvertedF::tuple_t>::value;
     }
 
     int invoke(lua_State* L) override
@@ -68,7 +124,7 @@ public:
 private:
     template <std::size_t Idx>
     void param_conversion_steps_impl(
-        lua_State*, std::vector<unsigned>&, int&,
+        lua_State*, unsigned*, int&,
         std::integral_constant<std::size_t, Idx>,
         std::integral_constant<std::size_t, Idx>)
     {
@@ -77,7 +133,7 @@ private:
 
     template <std::size_t Idx, typename Size>
     void param_conversion_steps_impl(
-        lua_State* L, std::vector<unsigned>& result, int& lidx,
+        lua_State* L, unsigned* result, int& lidx,
         std::integral_constant<std::size_t, Idx>, Size)
     {
         //std::cout << lidx << " -> " << Idx << ": ";
@@ -121,10 +177,29 @@ private:
     vec m_overloads;
 };
 
-
+// Makes all overload sets discard their cached resolutions before their next
+// call. Must be called when an implicit ctor is added, because it changes
+// the conversion steps of already seen argument signatures.
+APOLLO_API void invalidate_overload_caches() BOOST_NOEXCEPT;
 
 } // namespace detail
 
+struct overload_cache_stats {
+    // False if the overload set contains converters that are not type
+    // determined, so that overload resolution is never cached.
+    bool enabled;
+    unsigned long n_hits;
+    unsigned long n_misses;
+};
+
+// Returns the statistics of the overload resolution cache of the overload set
+// at idx. Throws a to_cpp_conversion_error if there is no overload set at idx.
+// Adding an implicit ctor (see add_implicit_ctor()) clears the caches of all
+// overload sets, because it can change which overload is best for arguments
+// that were seen before.
+APOLLO_API overload_cache_stats get_overload_cache_stats(
+    lua_State* L, int idx);
+
 template <>
 struct converter<detail::overloadset>: converter_base<converter<detail::overloadset>> {
     static int push(lua_State* L, detail::overloadset&& ovls)
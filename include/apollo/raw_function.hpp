@@ -39,6 +39,18 @@ struct msvc_inlining_helper {
     }
 };
 
+#if LUA_VERSION_NUM >= 502
+// Returned instead of a number of results by the converter of async_result
+// (see async_result.hpp) to make raw_function::caught() yield the calling
+// coroutine or raise the error message on top of the stack. Both must happen
+// only after all C++ frames of the call have been left, since lua_yieldk()
+// and lua_error() do not return.
+BOOST_CONSTEXPR_OR_CONST int yield_results = -1;
+BOOST_CONSTEXPR_OR_CONST int error_results = -2;
+
+APOLLO_API int finish_async_call(lua_State* L, int n_results);
+#endif // LUA_VERSION_NUM >= 502
+
 } // namespace detail
 
 struct raw_function {
@@ -50,8 +62,13 @@ struct raw_function {
     static BOOST_CONSTEXPR raw_function caught() BOOST_NOEXCEPT
     {
         return static_cast<lua_CFunction>([](lua_State* L) -> int {
-            return exceptions_to_lua_errors_L(
+            int const n_results = exceptions_to_lua_errors_L(
                 L, detail::msvc_inlining_helper<lua_CFunction, FVal>());
+#if LUA_VERSION_NUM >= 502
+            if (n_results < 0)
+                return detail::finish_async_call(L, n_results);
+#endif
+            return n_results;
         });
     }
 
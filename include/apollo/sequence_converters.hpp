@@ -0,0 +1,160 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef APOLLO_SEQUENCE_CONVERTERS_HPP_INCLUDED
+#define APOLLO_SEQUENCE_CONVERTERS_HPP_INCLUDED \
+    APOLLO_SEQUENCE_CONVERTERS_HPP_INCLUDED
+
+// Converters between Lua sequences (tables with the keys 1..n) and
+// std::vector, std::deque and std::array.
+
+#include <apollo/detail/container_element.hpp>
+
+#include <array>
+#include <deque>
+#include <vector>
+
+namespace apollo {
+
+namespace detail {
+
+template <typename T, typename A>
+struct lua_type_id<std::vector<T, A>>
+    : std::integral_constant<int, LUA_TTABLE> {};
+
+template <typename T, typename A>
+struct lua_type_id<std::deque<T, A>>
+    : std::integral_constant<int, LUA_TTABLE> {};
+
+template <typename T, std::size_t N>
+struct lua_type_id<std::array<T, N>>
+    : std::integral_constant<int, LUA_TTABLE> {};
+
+template <typename Seq>
+struct sequence_size_constraint {
+    static bool allows(std::size_t) { return true; }
+};
+
+template <typename T, std::size_t N>
+struct sequence_size_constraint<std::array<T, N>> {
+    static bool allows(std::size_t size) { return size == N; }
+};
+
+template <typename Seq>
+void reserve_sequence(Seq&, std::size_t)
+{ }
+
+template <typename T, typename A>
+void reserve_sequence(std::vector<T, A>& seq, std::size_t size)
+{
+    seq.reserve(size);
+}
+
+template <typename Seq, typename T>
+void set_sequence_element(Seq& seq, std::size_t, T&& v)
+{
+    seq.push_back(std::forward<T>(v));
+}
+
+template <typename T, std::size_t N, typename U>
+void set_sequence_element(std::array<T, N>& seq, std::size_t i, U&& v)
+{
+    seq[i] = std::forward<U>(v);
+}
+
+template <typename Seq>
+struct sequence_converter: converter_base<converter<Seq>> {
+private:
+    using element_t = typename Seq::value_type;
+    using element = container_element<element_t>;
+    static_assert(!is_borrowed_string<element_t>::value,
+        "Sequences cannot hold strings borrowed from Lua; use std::string.");
+
+public:
+    static int push(lua_State* L, Seq const& seq)
+    {
+        // Presize the array part, so that filling it never reallocates.
+        lua_createtable(L, static_cast<int>(seq.size()), 0);
+        int i = 0;
+        for (auto const& v: seq) {
+            push_converter_for<element_t>().push(L, v);
+            lua_rawseti(L, -2, ++i);
+        }
+        return 1;
+    }
+
+    // The maximum of the elements' conversion steps, or no_conversion if any
+    // element is not convertible.
+    static unsigned n_conversion_steps(lua_State* L, int idx)
+    {
+        if (!lua_istable(L, idx))
+            return no_conversion;
+        std::size_t const size = lua_rawlen(L, idx);
+        if (!sequence_size_constraint<Seq>::allows(size))
+            return no_conversion;
+        idx = lua_absindex(L, idx);
+        unsigned n_steps = 0;
+        for (std::size_t i = 1; i <= size; ++i) {
+            lua_rawgeti(L, idx, static_cast<int>(i));
+            unsigned const n_elem_steps = element::n_conversion_steps(L, -1);
+            lua_pop(L, 1);
+            if (n_elem_steps == no_conversion)
+                return no_conversion;
+            if (n_elem_steps > n_steps)
+                n_steps = n_elem_steps;
+        }
+        return n_steps;
+    }
+
+    static Seq to(lua_State* L, int idx)
+    {
+        return to_impl<&element::to>(L, idx);
+    }
+
+    // Checks and converts each element in a single pass, instead of
+    // traversing the table twice (for n_conversion_steps() and to()).
+    static Seq safe_to(lua_State* L, int idx)
+    {
+        if (!lua_istable(L, idx)
+            || !sequence_size_constraint<Seq>::allows(lua_rawlen(L, idx))
+        ) {
+            BOOST_THROW_EXCEPTION(to_cpp_conversion_error());
+        }
+        return to_impl<&element::safe_to>(L, idx);
+    }
+
+private:
+    template <element_t (*ToElement)(lua_State*, int)>
+    static Seq to_impl(lua_State* L, int idx)
+    {
+        std::size_t const size = lua_rawlen(L, idx);
+        idx = lua_absindex(L, idx);
+        Seq result;
+        reserve_sequence(result, size);
+        for (std::size_t i = 0; i < size; ++i) {
+            lua_rawgeti(L, idx, static_cast<int>(i + 1));
+            set_sequence_element(result, i, (*ToElement)(L, -1));
+            lua_pop(L, 1);
+        }
+        return result;
+    }
+};
+
+} // namespace detail
+
+template <typename T, typename A>
+struct converter<std::vector<T, A>>
+    : detail::sequence_converter<std::vector<T, A>> {};
+
+template <typename T, typename A>
+struct converter<std::deque<T, A>>
+    : detail::sequence_converter<std::deque<T, A>> {};
+
+template <typename T, std::size_t N>
+struct converter<std::array<T, N>>
+    : detail::sequence_converter<std::array<T, N>> {};
+
+} // namespace apollo
+
+#endif // APOLLO_SEQUENCE_CONVERTERS_HPP_INCLUDED
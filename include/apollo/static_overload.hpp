@@ -0,0 +1,207 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef APOLLO_STATIC_OVERLOAD_HPP_INCLUDED
+#define APOLLO_STATIC_OVERLOAD_HPP_INCLUDED APOLLO_STATIC_OVERLOAD_HPP_INCLUDED
+
+// Overload sets whose overloads are known at compile time. Like
+// to_raw_function() for single functions, make_static_overloadset() results
+// in a plain lua_CFunction without upvalues: all conversions are inlined and
+// no virtual calls or heap allocations are involved.
+//
+// Overload resolution works like for make_overloadset() (see overload.hpp),
+// except that overloads taking exactly lua_gettop() Lua arguments are
+// considered first; the other ones are only tried if none of them is viable.
+
+#include <apollo/overload.hpp>
+#include <apollo/to_raw_function.hpp>
+
+#include <array>
+
+namespace apollo {
+
+namespace detail {
+
+template <int... Ns>
+struct int_sum;
+
+template <>
+struct int_sum<>: std::integral_constant<int, 0> {};
+
+template <int N, int... Ns>
+struct int_sum<N, Ns...>
+    : std::integral_constant<int, N + int_sum<Ns...>::value> {};
+
+template <std::size_t... Ns>
+struct size_max;
+
+template <>
+struct size_max<>: std::integral_constant<std::size_t, 0> {};
+
+template <std::size_t N, std::size_t... Ns>
+struct size_max<N, Ns...>: std::integral_constant<std::size_t,
+    (N > size_max<Ns...>::value ? N : size_max<Ns...>::value)> {};
+
+} // namespace detail
+
+template <
+    typename F, F FVal,
+    typename ResultConverter, typename... ArgConverters>
+struct static_overload_with {
+    // Number of C++ parameters.
+    static std::size_t const arity = sizeof...(ArgConverters);
+
+    // Number of Lua arguments consumed if all arguments are present.
+    static int const n_lua_args = detail::int_sum<
+        ArgConverters::n_consumed...>::value;
+
+    // Stores the conversion steps of each parameter in
+    // param_conversion_steps (which must have room for arity elements) and
+    // the number of consumed Lua arguments in n_lua_args_consumed. Returns
+    // false if a parameter is not convertible; the remaining steps are not
+    // calculated then.
+    static bool calculate_quality(
+        lua_State* L, unsigned* param_conversion_steps,
+        int& n_lua_args_consumed)
+    {
+        (void)L; // Unused if there are no parameters.
+        int lidx = 1;
+        bool viable = true;
+        int const evaluate_in_order[] = {0, ((viable = viable && (
+            (*param_conversion_steps++ = n_conversion_steps_with(
+                ArgConverters(), L, lidx, &lidx))
+            != no_conversion)), 0)...};
+        (void)evaluate_in_order;
+        n_lua_args_consumed = lidx - 1;
+        return viable;
+    }
+
+    static int invoke(lua_State* L)
+    {
+        return detail::static_entry_point<
+            F, FVal, ResultConverter, ArgConverters...>(L);
+    }
+
+    static void push_signature(lua_State* L) // For error messages.
+    {
+        auto const name = boost::typeindex::type_id<F>().pretty_name();
+        lua_pushlstring(L, name.data(), name.size());
+    }
+};
+
+namespace detail {
+
+template <typename F, F FVal, typename ConverterTuple>
+struct default_static_overload;
+
+template <typename F, F FVal, typename... Converters>
+struct default_static_overload<F, FVal, std::tuple<Converters...>> {
+    using type = static_overload_with<F, FVal, Converters...>;
+};
+
+template <typename... Overloads>
+class static_overload_dispatcher {
+public:
+    static int entry_point(lua_State* L)
+    {
+        lua_CFunction const f = select_overload(L);
+        return f ? f(L) : lua_error(L);
+    }
+
+private:
+    static std::size_t const n_overloads = sizeof...(Overloads);
+    static std::size_t const max_arity = size_max<
+        Overloads::arity...>::value;
+
+    struct resolution_state {
+        lua_State* L;
+        int n_args;
+        bool exact_arity; // Only consider overloads with n_lua_args == n_args?
+        unsigned* steps_storage; // n_overloads * max_arity
+        overload_quality* qualities;
+        std::size_t* best;
+        std::size_t n_best;
+        std::size_t idx; // Index of the next overload to consider.
+    };
+
+    template <typename Overload>
+    static void consider(resolution_state& s)
+    {
+        std::size_t const idx = s.idx++;
+        if ((Overload::n_lua_args == s.n_args) != s.exact_arity)
+            return;
+        unsigned* const steps = s.steps_storage + idx * max_arity;
+        auto& quality = s.qualities[idx];
+        if (!Overload::calculate_quality(
+                s.L, steps, quality.n_lua_args_consumed)) {
+            return;
+        }
+        quality.param_conversion_steps = steps;
+        quality.n_params = Overload::arity;
+        if (s.n_best == 0) {
+            s.best[0] = idx;
+            s.n_best = 1;
+        } else {
+            s.n_best = update_best_overloads(
+                s.qualities, s.best, s.n_best, idx);
+        }
+    }
+
+    static void consider_all(resolution_state& s)
+    {
+        s.idx = 0;
+        int const consider_in_order[] = {(consider<Overloads>(s), 0)...};
+        (void)consider_in_order;
+    }
+
+    // Returns nullptr and pushes an error message if no unique best overload
+    // exists.
+    static lua_CFunction select_overload(lua_State* L)
+    {
+        static lua_CFunction const invokers[] = {&Overloads::invoke...};
+        static void (* const push_signatures[])(lua_State*) = {
+            &Overloads::push_signature...};
+
+        std::array<unsigned, n_overloads * max_arity> steps_storage;
+        std::array<overload_quality, n_overloads> qualities;
+        std::array<std::size_t, n_overloads> best;
+        resolution_state s = {
+            L, lua_gettop(L), true,
+            steps_storage.data(), qualities.data(), best.data(), 0, 0};
+        consider_all(s);
+        if (s.n_best == 0) {
+            s.exact_arity = false;
+            consider_all(s);
+        }
+        if (s.n_best == 1)
+            return invokers[best[0]];
+        push_static_overload_error(
+            L, push_signatures, n_overloads, best.data(), s.n_best);
+        return nullptr;
+    }
+};
+
+} // namespace detail
+
+template <typename F, F FVal>
+using static_overload = typename detail::default_static_overload<
+    F, FVal, decltype(detail::default_converters(FVal))>::type;
+
+#define APOLLO_STATIC_OVERLOAD(...) \
+    apollo::static_overload<APOLLO_FN_DECLTYPE(__VA_ARGS__), __VA_ARGS__>
+
+// Usage:
+//     make_static_overloadset<
+//         APOLLO_STATIC_OVERLOAD(&f1), APOLLO_STATIC_OVERLOAD(&f2)>()
+template <typename... Overloads>
+BOOST_CONSTEXPR raw_function make_static_overloadset() BOOST_NOEXCEPT
+{
+    static_assert(sizeof...(Overloads) > 0, "Empty overload set.");
+    return raw_function::caught<
+        &detail::static_overload_dispatcher<Overloads...>::entry_point>();
+}
+
+} // namespace apollo
+
+#endif // APOLLO_STATIC_OVERLOAD_HPP_INCLUDED
@@ -0,0 +1,138 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef APOLLO_TUPLE_CONVERTERS_HPP_INCLUDED
+#define APOLLO_TUPLE_CONVERTERS_HPP_INCLUDED \
+    APOLLO_TUPLE_CONVERTERS_HPP_INCLUDED
+
+// Converters for std::tuple and std::pair: each element is a separate Lua
+// value, so functions returning a tuple return multiple values to Lua, and
+// a tuple parameter consumes one Lua argument per element.
+
+#include <apollo/converters.hpp>
+#include <apollo/detail/integer_seq.hpp>
+#include <apollo/detail/ref_binder.hpp>
+
+#include <algorithm>
+#include <tuple>
+#include <utility>
+
+namespace apollo {
+
+template <typename... Ts>
+struct convert_cref_by_val<std::tuple<Ts...>>: std::true_type {};
+
+template <typename T1, typename T2>
+struct convert_cref_by_val<std::pair<T1, T2>>: std::true_type {};
+
+namespace detail {
+
+// Number of Lua values consumed by the first N of Ts.
+template <int N, typename... Ts>
+struct n_consumed_before: std::integral_constant<int, 0> {};
+
+template <int N, typename T, typename... Ts>
+struct n_consumed_before<N, T, Ts...>: std::integral_constant<int, N == 0 ?
+    0 : pull_converter_for<T>::n_consumed
+        + n_consumed_before<(N > 0 ? N - 1 : 0), Ts...>::value>
+{};
+
+template <typename... Ts>
+struct tuple_elements;
+
+template <>
+struct tuple_elements<> {
+    static unsigned n_conversion_steps(lua_State*, int) { return 0; }
+};
+
+template <typename T, typename... Ts>
+struct tuple_elements<T, Ts...> {
+    // The maximum of the elements' conversion steps, or no_conversion if any
+    // element is not convertible.
+    static unsigned n_conversion_steps(lua_State* L, int idx)
+    {
+        unsigned const n_steps = apollo::n_conversion_steps<T>(L, idx, &idx);
+        if (n_steps == no_conversion)
+            return no_conversion;
+        unsigned const n_rest_steps =
+            tuple_elements<Ts...>::n_conversion_steps(L, idx);
+        return n_rest_steps == no_conversion ?
+            no_conversion : (std::max)(n_steps, n_rest_steps);
+    }
+};
+
+template <typename Tuple, typename... Ts>
+struct tuple_converter: converter_base<converter<Tuple>> {
+private:
+    using seq_t = iseq_n_t<sizeof...(Ts)>;
+
+public:
+    static BOOST_CONSTEXPR_OR_CONST int n_consumed =
+        n_consumed_before<sizeof...(Ts), Ts...>::value;
+
+    static int push(lua_State* L, Tuple const& t)
+    {
+        return push_elements(L, t, seq_t());
+    }
+
+    static int push(lua_State* L, Tuple&& t)
+    {
+        return push_elements(L, std::move(t), seq_t());
+    }
+
+    static unsigned n_conversion_steps(lua_State* L, int idx)
+    {
+        return tuple_elements<Ts...>::n_conversion_steps(L, idx);
+    }
+
+    static Tuple to(lua_State* L, int idx)
+    {
+        return to_elements(L, idx, seq_t());
+    }
+
+    // Checks and converts each element in a single pass.
+    static Tuple safe_to(lua_State* L, int idx)
+    {
+        return safe_to_elements(L, idx, seq_t());
+    }
+
+private:
+    template <typename T, int... Is>
+    static int push_elements(lua_State* L, T&& t, iseq<Is...>)
+    {
+        return detail::push_impl(L, std::get<Is>(std::forward<T>(t))...);
+    }
+
+    // The index of each element is known at compile time, so the elements
+    // can be converted in any order.
+    template <int... Is>
+    static Tuple to_elements(lua_State* L, int idx, iseq<Is...>)
+    {
+        (void)L; (void)idx; // Unused for empty tuples.
+        return Tuple(unwrap_ref(unchecked_to<Ts>(
+            L, idx + n_consumed_before<Is, Ts...>::value))...);
+    }
+
+    template <int... Is>
+    static Tuple safe_to_elements(lua_State* L, int idx, iseq<Is...>)
+    {
+        (void)L; (void)idx;
+        return Tuple(unwrap_ref(apollo::to<Ts>(
+            L, idx + n_consumed_before<Is, Ts...>::value))...);
+    }
+};
+
+} // namespace detail
+
+template <typename... Ts>
+struct converter<std::tuple<Ts...>>
+    : detail::tuple_converter<std::tuple<Ts...>, Ts...> {};
+
+template <typename T1, typename T2>
+struct converter<std::pair<T1, T2>>
+    : detail::tuple_converter<std::pair<T1, T2>, T1, T2> {};
+
+} // namespace apollo
+
+#endif // APOLLO_TUPLE_CONVERTERS_HPP_INCLUDED
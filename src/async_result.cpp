@@ -0,0 +1,107 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include <apollo/lua_include.hpp>
+
+#if LUA_VERSION_NUM >= 502
+
+#include <apollo/async_result.hpp>
+
+namespace {
+
+// The stack of a resumed call is that of the original call (ending at
+// index ctx) followed by the values passed to lua_resume() by
+// async_state::resume(): true and the results or false and an error message.
+int finish_resumed_call(lua_State* L, int ctx)
+{
+    int const first = ctx + 1;
+    BOOST_ASSERT(lua_gettop(L) >= first);
+    if (!lua_toboolean(L, first))
+        return lua_error(L);
+    return lua_gettop(L) - first;
+}
+
+#if LUA_VERSION_NUM >= 503
+int continue_async_call(lua_State* L, int status, lua_KContext ctx)
+{
+    (void)status;
+    BOOST_ASSERT(status == LUA_YIELD);
+    return finish_resumed_call(L, static_cast<int>(ctx));
+}
+#else
+int continue_async_call(lua_State* L)
+{
+    int ctx = 0;
+    int const status = lua_getctx(L, &ctx);
+    (void)status;
+    BOOST_ASSERT(status == LUA_YIELD);
+    return finish_resumed_call(L, ctx);
+}
+#endif
+
+} // anonymous namespace
+
+namespace apollo {
+
+APOLLO_API int detail::finish_async_call(lua_State* L, int n_results)
+{
+    if (n_results == error_results)
+        return lua_error(L);
+    BOOST_ASSERT(n_results == yield_results);
+    return lua_yieldk(L, 0, lua_gettop(L), &continue_async_call);
+}
+
+int detail::async_state::suspend(lua_State* L)
+{
+    BOOST_ASSERT(!m_done && !suspended());
+#if LUA_VERSION_NUM >= 503
+    bool const yieldable = lua_isyieldable(L) != 0;
+#else
+    // Lua 5.2 cannot tell whether there is a C call boundary, in which case
+    // lua_yieldk() raises an error and the result stays unusable.
+    bool const yieldable = !lua_pushthread(L);
+    lua_pop(L, 1);
+#endif
+    if (!yieldable) {
+        lua_pushliteral(L, "attempt to yield from outside a coroutine");
+        return error_results;
+    }
+    lua_pushthread(L);
+    m_thread.reset(L, -1, ref_mode::move);
+    return yield_results;
+}
+
+int detail::async_state::resume(int n_args)
+{
+    BOOST_ASSERT(suspended());
+    set_done();
+    lua_State* const L = m_thread.L();
+    // Keep the thread referenced while it runs, but not afterwards.
+    registry_reference const thread(std::move(m_thread));
+    return lua_resume(L, nullptr, n_args);
+}
+
+int detail::async_state::reject(std::string const& msg)
+{
+    if (!suspended()) {
+        set_done();
+        m_error = msg;
+        return LUA_OK;
+    }
+    lua_State* const L = thread();
+    lua_pushboolean(L, false);
+    lua_pushlstring(L, msg.data(), msg.size());
+    return resume(2);
+}
+
+int detail::async_state::push_error(lua_State* L) const
+{
+    BOOST_ASSERT(m_done);
+    lua_pushlstring(L, m_error.data(), m_error.size());
+    return error_results;
+}
+
+} // namespace apollo
+
+#endif // LUA_VERSION_NUM >= 502
@@ -2,21 +2,373 @@
 // This file is subject to the terms of the BSD 2-Clause License.
 // See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
 
+#include <apollo/builtin_types.hpp>
 #include <apollo/class.hpp>
 #include <apollo/gc.hpp>
 
-static apollo::detail::light_key object_tag = {};
+static apollo::detail::light_key const object_tag = {};
+static apollo::detail::light_key const property_tag = {};
+// Key of the indexer (see add_indexer()) in member tables.
+static apollo::detail::light_key const indexer_key = {};
 
 static int gc_instance(lua_State* L) BOOST_NOEXCEPT
 {
-    if (!apollo::detail::is_apollo_instance(L, 1))
+    using namespace apollo::detail;
+    if (!is_apollo_instance(L, 1))
         luaL_argerror(L, 1, "Expected apollo object.");
-    apollo::gc_object<apollo::detail::instance_holder>(L);
+    auto header = static_cast<instance_header*>(lua_touserdata(L, 1));
+    // Destroy through pointer to interface class.
+    header->holder->~instance_holder();
+    header->tag = nullptr;
     lua_pushnil(L);
     lua_setmetatable(L, 1);
     return 0;
 }
 
+namespace {
+
+// Member table entry for properties (see add_property()), fields (see
+// add_field()) and indexers (see add_indexer()).
+struct property_udata {
+    void const* tag; // Points to property_tag.
+    lua_CFunction getter; // Only for properties.
+    lua_CFunction setter; // Only for properties.
+    // Only for fields: the class (the one add_field() was called for), the
+    // offset of the base subobject declaring the field in it and the offset
+    // of the field in that subobject.
+    apollo::detail::class_info const* cls;
+    std::size_t base_offset;
+    std::size_t offset;
+    apollo::detail::field_type type; // field_type::none for properties.
+    bool is_read_only; // Only for fields.
+};
+
+template <typename T>
+int push_field(lua_State* L, void const* field)
+{
+    return apollo::push(L, *static_cast<T const*>(field));
+}
+
+template <typename T>
+bool assign_field(lua_State* L, int idx, void* field)
+{
+    using converter_t = apollo::converter<T>;
+    if (converter_t::n_conversion_steps(L, idx) == apollo::no_conversion)
+        return false;
+    *static_cast<T*>(field) = converter_t::to(L, idx);
+    return true;
+}
+
+struct field_accessors {
+    int (*push)(lua_State* L, void const* field);
+    bool (*assign)(lua_State* L, int idx, void* field);
+};
+
+#define APOLLO_DETAIL_FIELD_ACCESSORS(t) {&push_field<t>, &assign_field<t>}
+
+// Indexed by field_type.
+field_accessors const field_accessors_by_type[] = {
+    {nullptr, nullptr}, // field_type::none
+    APOLLO_DETAIL_FIELD_ACCESSORS(bool),
+    APOLLO_DETAIL_FIELD_ACCESSORS(char),
+    APOLLO_DETAIL_FIELD_ACCESSORS(signed char),
+    APOLLO_DETAIL_FIELD_ACCESSORS(unsigned char),
+    APOLLO_DETAIL_FIELD_ACCESSORS(short),
+    APOLLO_DETAIL_FIELD_ACCESSORS(unsigned short),
+    APOLLO_DETAIL_FIELD_ACCESSORS(int),
+    APOLLO_DETAIL_FIELD_ACCESSORS(unsigned),
+    APOLLO_DETAIL_FIELD_ACCESSORS(long),
+    APOLLO_DETAIL_FIELD_ACCESSORS(unsigned long),
+    APOLLO_DETAIL_FIELD_ACCESSORS(long long),
+    APOLLO_DETAIL_FIELD_ACCESSORS(unsigned long long),
+    APOLLO_DETAIL_FIELD_ACCESSORS(float),
+    APOLLO_DETAIL_FIELD_ACCESSORS(double)
+};
+
+#undef APOLLO_DETAIL_FIELD_ACCESSORS
+
+} // anonymous namespace
+
+static property_udata const* as_property(lua_State* L, int idx)
+{
+    if (lua_type(L, idx) != LUA_TUSERDATA
+        || lua_rawlen(L, idx) != sizeof(property_udata)
+    ) {
+        return nullptr;
+    }
+    auto prop = static_cast<property_udata const*>(lua_touserdata(L, idx));
+    return prop->tag == property_tag ? prop : nullptr;
+}
+
+static char const* member_name(lua_State* L, int idx)
+{
+    return lua_type(L, idx) == LUA_TSTRING ?
+        lua_tostring(L, idx) : "(non-string key)";
+}
+
+// Returns the address of the field prop of the instance at index 1 or raises
+// an error. Fields are found through the member table of the instance's
+// class, so the instance is of the field's class or one derived from it.
+static void* field_address(
+    lua_State* L, property_udata const& prop, bool for_writing)
+{
+    using namespace apollo::detail;
+    if (!is_apollo_instance(L, 1))
+        luaL_argerror(L, 1, "Expected apollo object.");
+    auto const& header = *as_header(L, 1);
+    if (for_writing && header.is_const)
+        luaL_error(L, "Attempt to assign to a field of a const object.");
+    void* obj = instance_object(header);
+    if (!obj)
+        luaL_error(L, "Attempt to access a field of a null object.");
+    if (header.cls != prop.cls) {
+        char const* err;
+        obj = try_cast_class(obj, *header.cls, prop.cls->static_id, err);
+        if (err)
+            luaL_error(L, "%s", err);
+    }
+    void* const declaring_obj = static_cast<char*>(obj) + prop.base_offset;
+    return static_cast<char*>(declaring_obj) + prop.offset;
+}
+
+// __index metamethod; upvalue 1 is the member table of the instance's class.
+static int index_instance(lua_State* L)
+{
+    lua_settop(L, 2);
+    if (lua_type(L, 2) != LUA_TSTRING) {
+        lua_rawgetp(L, lua_upvalueindex(1), indexer_key);
+        if (auto indexer = as_property(L, 3)) {
+            if (!indexer->getter)
+                return luaL_error(L, "Indexer is write-only.");
+            lua_settop(L, 2);
+            return indexer->getter(L);
+        }
+        lua_pop(L, 1);
+    }
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(1));
+    if (auto prop = as_property(L, 3)) {
+        if (prop->type != apollo::detail::field_type::none) {
+            return field_accessors_by_type[static_cast<std::size_t>(
+                prop->type)].push(L, field_address(L, *prop, false));
+        }
+        if (!prop->getter) {
+            return luaL_error(
+                L, "Property '%s' is write-only.", member_name(L, 2));
+        }
+        // Call the getter directly, with the instance as only argument.
+        lua_settop(L, 1);
+        return prop->getter(L);
+    }
+    return 1; // Methods and nil for unknown members.
+}
+
+// __newindex metamethod; upvalue 1 is the member table of the instance's class.
+static int newindex_instance(lua_State* L)
+{
+    lua_settop(L, 3);
+    if (lua_type(L, 2) != LUA_TSTRING) {
+        lua_rawgetp(L, lua_upvalueindex(1), indexer_key);
+        if (auto indexer = as_property(L, 4)) {
+            if (!indexer->setter)
+                return luaL_error(L, "Indexer is read-only.");
+            lua_settop(L, 3);
+            indexer->setter(L);
+            return 0;
+        }
+        lua_pop(L, 1);
+    }
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(1));
+    auto prop = as_property(L, 4);
+    if (prop && prop->type != apollo::detail::field_type::none
+        && !prop->is_read_only
+    ) {
+        void* const field = field_address(L, *prop, true);
+        if (!field_accessors_by_type[static_cast<std::size_t>(
+                prop->type)].assign(L, 3, field)) {
+            return luaL_error(L, "Invalid value for field '%s' (%s given).",
+                member_name(L, 2), luaL_typename(L, 3));
+        }
+        return 0;
+    }
+    if (!prop || !prop->setter) {
+        return luaL_error(L,
+            prop ? "Property '%s' is read-only." : "No writable member '%s'.",
+            member_name(L, 2));
+    }
+    lua_settop(L, 3);
+    lua_remove(L, 2); // Call setter(instance, value).
+    prop->setter(L);
+    return 0;
+}
+
+// Sets __index and __newindex of the metatable at mt_idx to the member
+// dispatch functions for the member table at the top of the stack, which is
+// popped.
+static void set_member_dispatch(lua_State* L, int mt_idx)
+{
+    mt_idx = lua_absindex(L, mt_idx);
+    lua_pushliteral(L, "__index");
+    lua_rawget(L, mt_idx);
+    BOOST_ASSERT_MSG(
+        lua_isnil(L, -1) || lua_tocfunction(L, -1) == &index_instance,
+        "Members added to a class whose metatable has a custom __index.");
+    lua_pop(L, 1);
+
+    lua_pushliteral(L, "__index");
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, &index_instance, 1);
+    lua_rawset(L, mt_idx);
+
+    lua_pushliteral(L, "__newindex");
+    lua_insert(L, -2);
+    lua_pushcclosure(L, &newindex_instance, 1);
+    lua_rawset(L, mt_idx);
+}
+
+// Stores the member table at the top of the stack (without popping it) as the
+// one of cls and installs it in the metatable of cls, if that already exists.
+static void store_member_table(
+    lua_State* L, apollo::detail::class_info const& cls)
+{
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, cls.member_table_key);
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &cls);
+    if (lua_istable(L, -1)) {
+        lua_pushvalue(L, -2);
+        set_member_dispatch(L, -2);
+    }
+    lua_pop(L, 1);
+}
+
+// Copies all entries of the table at the top of the stack that are not yet
+// in the one below it into the latter.
+static void merge_members(lua_State* L)
+{
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        lua_pushvalue(L, -2);
+        lua_rawget(L, -5);
+        bool const is_present = !lua_isnil(L, -1);
+        lua_pop(L, 1);
+        if (is_present) {
+            lua_pop(L, 1);
+        } else {
+            lua_pushvalue(L, -2);
+            lua_insert(L, -2);
+            lua_rawset(L, -5);
+        }
+    }
+}
+
+// Adds the members of cls and its bases that are not yet in the table at the
+// top of the stack to it. Members of cls take precedence over inherited ones
+// and members of the first direct base over those of later ones.
+static void add_class_members(
+    lua_State* L, apollo::detail::class_info const& cls)
+{
+    using namespace apollo::detail;
+    lua_rawgetp(L, LUA_REGISTRYINDEX, cls.own_member_table_key);
+    if (!lua_isnil(L, -1))
+        merge_members(L);
+    lua_pop(L, 1);
+    for (auto const& base: cls.bases) {
+        if (base.n_intermediate_bases != 0)
+            continue; // Already added with a direct base.
+        add_class_members(L, registered_class(L, base.static_id));
+    }
+}
+
+// Pushes the member table of cls, or nil if neither cls nor any of its bases
+// has members. The member table of a class contains the ones of its bases
+// too, so it is built from them when first needed.
+static void push_member_table(
+    lua_State* L, apollo::detail::class_info const& cls)
+{
+    lua_rawgetp(L, LUA_REGISTRYINDEX, cls.member_table_key);
+    if (!lua_isnil(L, -1))
+        return;
+    lua_pop(L, 1);
+
+    lua_newtable(L);
+    add_class_members(L, cls);
+    lua_pushnil(L);
+    if (!lua_next(L, -2)) {
+        lua_pop(L, 1);
+        lua_pushnil(L);
+        return;
+    }
+    lua_pop(L, 2); // Pop key and value.
+    store_member_table(L, cls);
+}
+
+// Brings the member table of cls up to date after a member was added to cls
+// or one of its bases. Existing tables are refilled in place because the
+// metamethods of the metatable refer to them; missing ones are only built if
+// the metatable exists already (otherwise, that is done when it is created).
+static void update_member_table(
+    lua_State* L, apollo::detail::class_info const& cls)
+{
+    lua_rawgetp(L, LUA_REGISTRYINDEX, cls.member_table_key);
+    if (lua_istable(L, -1)) {
+        lua_pushnil(L);
+        while (lua_next(L, -2)) {
+            lua_pop(L, 1);
+            lua_pushvalue(L, -1);
+            lua_pushnil(L);
+            lua_rawset(L, -4);
+        }
+        add_class_members(L, cls);
+        lua_pop(L, 1);
+        return;
+    }
+    lua_pop(L, 1);
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &cls);
+    bool const has_metatable = lua_istable(L, -1);
+    lua_pop(L, 1);
+    if (has_metatable) {
+        push_member_table(L, cls);
+        lua_pop(L, 1);
+    }
+}
+
+// Adds the member with the key and value at the top of the stack (which are
+// popped) to cls, and thus to all classes derived from it.
+static void add_member(lua_State* L, apollo::detail::class_info const& cls)
+{
+    using namespace apollo::detail;
+    lua_rawgetp(L, LUA_REGISTRYINDEX, cls.own_member_table_key);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, cls.own_member_table_key);
+    }
+    lua_insert(L, -3);
+    lua_pushvalue(L, -2);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, -5);
+
+    // Own members take precedence, so an existing member table of cls can
+    // simply be updated.
+    lua_rawgetp(L, LUA_REGISTRYINDEX, cls.member_table_key);
+    if (lua_istable(L, -1)) {
+        lua_insert(L, -3);
+        lua_rawset(L, -3);
+        lua_pop(L, 2); // Pop member tables.
+    } else {
+        lua_pop(L, 4); // Pop nil, value, key and own member table.
+        update_member_table(L, cls);
+    }
+
+    registered_classes(L).for_each([L, &cls](class_info const& derived) {
+        if (derived.find_base(cls.static_id))
+            update_member_table(L, derived);
+    });
+}
+
 APOLLO_API void apollo::detail::push_instance_metatable(
     lua_State* L,
     class_info const& cls) BOOST_NOEXCEPT
@@ -26,37 +378,161 @@ APOLLO_API void apollo::detail::push_instance_metatable(
         BOOST_ASSERT(lua_isnil(L, -1));
         lua_pop(L, 1);
 
-        lua_createtable(L, 1, 1);
-
-        lua_pushlightuserdata(L, object_tag);
-        lua_rawseti(L, -2, 1);
+        lua_createtable(L, 0, 3);
 
         lua_pushliteral(L, "__gc");
-        // Destroy through pointer to interface class.
         lua_pushcfunction(L, &gc_instance);
         lua_rawset(L, -3);
 
         // Copy metatable because we also want to return it.
         lua_pushvalue(L, -1);
         lua_rawsetp(L, LUA_REGISTRYINDEX, &cls);
+
+        push_member_table(L, cls);
+        if (lua_isnil(L, -1))
+            lua_pop(L, 1);
+        else
+            set_member_dispatch(L, -2);
     }
-#ifndef NDEBUG
-    lua_rawgeti(L, -1, 1);
-    BOOST_ASSERT(lua_touserdata(L, -1) == object_tag);
-    lua_pop(L, 1);
-#endif
+}
+
+APOLLO_API void apollo::detail::set_member(
+    lua_State* L, class_info const& cls, char const* name)
+{
+    lua_pushstring(L, name);
+    lua_insert(L, -2);
+    add_member(L, cls);
+}
+
+APOLLO_API void apollo::detail::set_indexer(
+    lua_State* L, class_info const& cls,
+    lua_CFunction getter, lua_CFunction setter)
+{
+    BOOST_ASSERT_MSG(getter || setter, "Indexer without getter and setter.");
+    push(L, indexer_key);
+    auto indexer = static_cast<property_udata*>(
+        lua_newuserdata(L, sizeof(property_udata)));
+    indexer->tag = property_tag;
+    indexer->getter = getter;
+    indexer->setter = setter;
+    indexer->cls = nullptr;
+    indexer->base_offset = 0;
+    indexer->offset = 0;
+    indexer->type = field_type::none;
+    indexer->is_read_only = !setter;
+    add_member(L, cls);
+}
+
+APOLLO_API void apollo::detail::set_property(
+    lua_State* L, class_info const& cls, char const* name,
+    lua_CFunction getter, lua_CFunction setter)
+{
+    BOOST_ASSERT_MSG(getter || setter, "Property without getter and setter.");
+    auto prop = static_cast<property_udata*>(
+        lua_newuserdata(L, sizeof(property_udata)));
+    prop->tag = property_tag;
+    prop->getter = getter;
+    prop->setter = setter;
+    prop->cls = nullptr;
+    prop->base_offset = 0;
+    prop->offset = 0;
+    prop->type = field_type::none;
+    prop->is_read_only = !setter;
+    set_member(L, cls, name);
+}
+
+APOLLO_API void apollo::detail::set_field(
+    lua_State* L, class_info const& cls, char const* name, field_type type,
+    std::size_t base_offset, std::size_t offset, bool is_read_only)
+{
+    BOOST_ASSERT(type != field_type::none);
+    auto prop = static_cast<property_udata*>(
+        lua_newuserdata(L, sizeof(property_udata)));
+    prop->tag = property_tag;
+    prop->getter = nullptr;
+    prop->setter = nullptr;
+    prop->cls = &cls;
+    prop->base_offset = base_offset;
+    prop->offset = offset;
+    prop->type = type;
+    prop->is_read_only = is_read_only;
+    set_member(L, cls, name);
+}
+
+APOLLO_API void apollo::detail::init_instance_udata(
+    lua_State* L,
+    instance_holder* holder,
+    class_info const& cls) BOOST_NOEXCEPT
+{
+    auto header = static_cast<instance_header*>(lua_touserdata(L, -1));
+    header->holder = holder;
+    header->cls = &cls;
+    header->tag = object_tag;
+    push_instance_metatable(L, cls);
+    lua_setmetatable(L, -2);
 }
 
 APOLLO_API bool apollo::detail::is_apollo_instance(lua_State* L, int idx)
 {
-    // We don't have to check for type == userdata, as the object metatables get
-    // a __metatable field by default, blocking Lua code from geting hold of the
-    // object_tag.
-    if (!lua_getmetatable(L, idx))
+    // Only C++ code can write to the memory block of a userdata, so the tag in
+    // the header cannot be forged by Lua code.
+    return lua_type(L, idx) == LUA_TUSERDATA
+        && lua_rawlen(L, idx) >= sizeof(instance_header)
+        && static_cast<instance_header const*>(
+            lua_touserdata(L, idx))->tag == object_tag;
+}
+
+APOLLO_API bool apollo::detail::push_cached_instance(
+    lua_State* L,
+    class_info const& cls,
+    void const* obj,
+    boost::typeindex::type_info const& holder_type)
+{
+    lua_rawgetp(L, LUA_REGISTRYINDEX, cls.identity_cache_key);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
         return false;
+    }
+    lua_rawgetp(L, -1, obj);
+    lua_remove(L, -2); // Remove the cache table.
+    if (is_apollo_instance(L, -1)
+        && boost::typeindex::type_id_runtime(*as_holder(L, -1))
+            == boost::typeindex::type_index(holder_type)
+    ) {
+        return true;
+    }
+    lua_pop(L, 1);
+    return false;
+}
+
+APOLLO_API void apollo::detail::cache_instance(
+    lua_State* L, class_info const& cls, void const* obj)
+{
+    lua_rawgetp(L, LUA_REGISTRYINDEX, cls.identity_cache_key);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_createtable(L, 0, 1); // Metatable.
+        lua_pushliteral(L, "__mode");
+        lua_pushliteral(L, "v");
+        lua_rawset(L, -3);
+        lua_setmetatable(L, -2);
 
-    lua_rawgeti(L, -1, 1);
-    bool r = lua_touserdata(L, -1) == object_tag;
-    lua_pop(L, 2);
-    return r;
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, cls.identity_cache_key);
+    }
+    lua_pushvalue(L, -2);
+    lua_rawsetp(L, -2, obj);
+    lua_pop(L, 1);
+}
+
+APOLLO_API void apollo::detail::evict_cached_instance(
+    lua_State* L, class_info const& cls, void const* obj)
+{
+    lua_rawgetp(L, LUA_REGISTRYINDEX, cls.identity_cache_key);
+    if (!lua_isnil(L, -1)) {
+        lua_pushnil(L);
+        lua_rawsetp(L, -2, obj);
+    }
+    lua_pop(L, 1);
 }
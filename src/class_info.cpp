@@ -13,66 +13,210 @@
 #include <boost/exception/info.hpp>
 #include <boost/throw_exception.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <limits>
+#include <mutex>
 
-static apollo::detail::light_key const class_info_map_key = {};
+static apollo::detail::light_key const class_registry_key = {};
 static std::ptrdiff_t const error_ambiguous_base =
     std::numeric_limits<std::ptrdiff_t>::min();
 
 
 
+namespace {
+
+// Class IDs are stored in an open addressing hash table that is only modified
+// while holding class_id_mutex(), but can be read without locking: Slots are
+// published by atomically storing their type after their id, and are never
+// changed afterwards. When the table is grown, the old one is kept alive
+// (by the new one), because readers may still be using it.
+struct class_id_slot {
+    std::atomic<boost::typeindex::type_info const*> type;
+    std::size_t id;
+};
+
+struct class_id_table {
+    explicit class_id_table(std::size_t capacity_)
+        : capacity(capacity_)
+        , slots(new class_id_slot[capacity_])
+    {
+        BOOST_ASSERT((capacity & (capacity - 1)) == 0); // Power of two.
+        for (std::size_t i = 0; i < capacity; ++i)
+            slots[i].type.store(nullptr, std::memory_order_relaxed);
+    }
+
+    std::size_t capacity;
+    std::unique_ptr<class_id_slot[]> slots;
+    std::unique_ptr<class_id_table> previous;
+};
+
+std::size_t const no_class_id = static_cast<std::size_t>(-1);
+std::size_t const min_class_id_capacity = 64;
+
+std::size_t find_class_id(
+    class_id_table const& table,
+    boost::typeindex::type_info const& cls,
+    std::size_t hash)
+{
+    std::size_t const mask = table.capacity - 1;
+    for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+        auto const type = table.slots[i].type.load(std::memory_order_acquire);
+        if (!type)
+            return no_class_id;
+        if (*type == cls)
+            return table.slots[i].id;
+    }
+}
+
+// Precondition: cls is not in table and table has a free slot.
+void insert_class_id(
+    class_id_table& table,
+    boost::typeindex::type_info const& cls,
+    std::size_t hash,
+    std::size_t id)
+{
+    std::size_t const mask = table.capacity - 1;
+    std::size_t i = hash & mask;
+    while (table.slots[i].type.load(std::memory_order_relaxed))
+        i = (i + 1) & mask;
+    table.slots[i].id = id;
+    table.slots[i].type.store(&cls, std::memory_order_release);
+}
+
+std::size_t class_id_hash(boost::typeindex::type_info const& cls)
+{
+    return boost::typeindex::type_index(cls).hash_code();
+}
+
+// Function-local statics, because class IDs are allocated during static
+// initialization.
+std::mutex& class_id_mutex()
+{
+#ifdef BOOST_CLANG
+#    pragma clang diagnostic push
+#    pragma clang diagnostic ignored "-Wexit-time-destructors"
+#endif
+    static std::mutex mutex;
+#ifdef BOOST_CLANG
+#    pragma clang diagnostic pop
+#endif
+    return mutex;
+}
+
+std::atomic<class_id_table*>& current_class_id_table()
+{
+    static std::atomic<class_id_table*> table(nullptr);
+    return table;
+}
+
+} // anonymous namespace
+
 APOLLO_API std::size_t
 apollo::detail::allocate_class_id(boost::typeindex::type_info const& cls)
 {
+    auto& current_table = current_class_id_table();
+    std::size_t const hash = class_id_hash(cls);
+
+    // Fast path: The class already has an ID.
+    class_id_table* table = current_table.load(std::memory_order_acquire);
+    if (table) {
+        std::size_t const id = find_class_id(*table, cls, hash);
+        if (id != no_class_id)
+            return id;
+    }
+
+    std::lock_guard<std::mutex> lock(class_id_mutex());
 #ifdef BOOST_CLANG
 #    pragma clang diagnostic push
 #    pragma clang diagnostic ignored "-Wexit-time-destructors"
 #endif
-    static std::unordered_map<
-            boost::typeindex::type_index,
-            std::size_t,
-            boost::hash<boost::typeindex::type_index>
-        > ids;
+    static std::unique_ptr<class_id_table> owned_table;
 #ifdef BOOST_CLANG
 #    pragma clang diagnostic pop
 #endif
     static std::size_t next_id = 0;
-    auto inserted = ids.insert({cls, next_id});
-    if (inserted.second)
-        ++next_id;
-    return inserted.first->second;
+
+    table = owned_table.get();
+    if (table) { // Another thread may have allocated the ID in the meantime.
+        std::size_t const id = find_class_id(*table, cls, hash);
+        if (id != no_class_id)
+            return id;
+    }
+
+    // Keep the load factor at most 1/2.
+    if (!table || (next_id + 1) * 2 > table->capacity) {
+        std::unique_ptr<class_id_table> new_table(new class_id_table(
+            table ? table->capacity * 2 : min_class_id_capacity));
+        if (table) {
+            for (std::size_t i = 0; i < table->capacity; ++i) {
+                auto& slot = table->slots[i];
+                auto type = slot.type.load(std::memory_order_relaxed);
+                if (type) {
+                    insert_class_id(
+                        *new_table, *type, class_id_hash(*type), slot.id);
+                }
+            }
+        }
+        new_table->previous = std::move(owned_table);
+        owned_table = std::move(new_table);
+        table = owned_table.get();
+        current_table.store(table, std::memory_order_release);
+    }
+
+    insert_class_id(*table, cls, hash, next_id);
+    return next_id++;
 }
 
-APOLLO_API apollo::detail::class_info_map&
-apollo::detail::registered_classes(lua_State* L)
+APOLLO_API apollo::detail::class_info&
+apollo::detail::class_registry::insert(class_info&& cls)
 {
-    lua_rawgetp(L, LUA_REGISTRYINDEX, class_info_map_key);
-    auto classes = static_cast<class_info_map*>(lua_touserdata(L, -1));
-    lua_pop(L, 1);
-    if (classes)
-        return *classes;
-    classes = push_gc_object(L, class_info_map());
-    lua_rawsetp(L, LUA_REGISTRYINDEX, class_info_map_key);
-    return *classes;
+    BOOST_ASSERT_MSG(!m_frozen, "Cannot register classes in frozen registry.");
+    if (cls.static_id >= m_classes.size())
+        m_classes.resize(cls.static_id + 1);
+    auto& slot = m_classes[cls.static_id];
+    BOOST_ASSERT_MSG(!slot, "Class already registered!");
+    m_owned.emplace_back(new class_info(std::move(cls)));
+    slot = m_owned.back().get();
+    ++m_size;
+    return *slot;
 }
 
+APOLLO_API void apollo::detail::class_registry::attach(
+    std::shared_ptr<class_registry const> shared)
+{
+    BOOST_ASSERT_MSG(shared->is_frozen(),
+        "Only frozen registries can be shared.");
+    if (shared->m_classes.size() > m_classes.size())
+        m_classes.resize(shared->m_classes.size());
+    for (std::size_t i = 0; i < shared->m_classes.size(); ++i) {
+        if (class_info* cls = shared->m_classes[i]) {
+            BOOST_ASSERT_MSG(!m_classes[i], "Class already registered!");
+            m_classes[i] = cls;
+            ++m_size;
+        }
+    }
+    m_attached.push_back(std::move(shared));
+}
 
-APOLLO_API apollo::detail::class_info*
-apollo::detail::registered_class_opt(
-    lua_State* L, boost::typeindex::type_info const& type)
+APOLLO_API void apollo::detail::class_registry::freeze()
 {
-    auto& classes = registered_classes(L);
-    auto i_cls = classes.find(boost::typeindex::type_index(type));
-    return i_cls == classes.end() ? nullptr : &i_cls->second;
+    for (auto& cls: m_owned)
+        cls->is_frozen = true;
+    m_frozen = true;
 }
 
-APOLLO_API apollo::detail::class_info&
-apollo::detail::registered_class(
-    lua_State* L, boost::typeindex::type_info const& type)
+APOLLO_API apollo::detail::class_registry&
+apollo::detail::registered_classes(lua_State* L)
 {
-    auto cls = registered_class_opt(L, type);
-    BOOST_ASSERT_MSG(cls, "Use of unregistered class.");
-    return *cls;
+    lua_rawgetp(L, LUA_REGISTRYINDEX, class_registry_key);
+    auto classes = static_cast<class_registry*>(lua_touserdata(L, -1));
+    lua_pop(L, 1);
+    if (classes)
+        return *classes;
+    classes = push_gc_object(L, class_registry());
+    lua_rawsetp(L, LUA_REGISTRYINDEX, class_registry_key);
+    return *classes;
 }
 
 APOLLO_API void*
@@ -97,16 +241,16 @@ apollo::detail::try_cast_class(
     err = nullptr;
     if (BOOST_LIKELY(from.static_id == to))
         return obj;
-    auto i_base_relation = from.bases.find(to);
-    if (i_base_relation == from.bases.end()) {
+    auto base = from.find_base(to);
+    if (!base) {
         err = "Requested type is no base class.";
         return nullptr;
     }
-    if (i_base_relation->second.offset == error_ambiguous_base) {
+    if (base->offset == error_ambiguous_base) {
         err = "Requested type is ambigous base class.";
         return nullptr;
     }
-    return static_cast<char*>(obj) + i_base_relation->second.offset;
+    return static_cast<char*>(obj) + base->offset;
 }
 
 APOLLO_API unsigned apollo::detail::n_class_conversion_steps(
@@ -114,10 +258,53 @@ APOLLO_API unsigned apollo::detail::n_class_conversion_steps(
 {
     if (BOOST_LIKELY(from.static_id == to))
         return 0;
-    auto i_base_relation = from.bases.find(to);
-    if (i_base_relation == from.bases.end())
+    auto base = from.find_base(to);
+    if (!base)
         return no_conversion;
-    return i_base_relation->second.n_intermediate_bases + 1;
+    return base->n_intermediate_bases + 1;
+}
+
+APOLLO_API apollo::detail::class_info::base_relation const*
+apollo::detail::class_info::find_base(std::size_t id) const
+{
+    // Up to this many bases, a linear scan over the contiguous entries is
+    // faster than a binary search.
+    std::size_t const max_linear_search = 16;
+
+    if (bases.size() <= max_linear_search) {
+        for (auto& base: bases) {
+            if (base.static_id >= id)
+                return base.static_id == id ? &base : nullptr;
+        }
+        return nullptr;
+    }
+    auto i_base = std::lower_bound(bases.begin(), bases.end(), id,
+        [](base_relation const& base, std::size_t id_) {
+            return base.static_id < id_;
+        });
+    return i_base != bases.end() && i_base->static_id == id ?
+        &*i_base : nullptr;
+}
+
+static void add_base_relation(
+    std::vector<apollo::detail::class_info::base_relation>& bases,
+    apollo::detail::class_info::base_relation const& new_base)
+{
+    auto i_existing_base = std::find_if(bases.begin(), bases.end(),
+        [&new_base](apollo::detail::class_info::base_relation const& base) {
+            return base.static_id == new_base.static_id;
+        });
+    if (i_existing_base == bases.end()) {
+        bases.push_back(new_base);
+    } else if (
+        i_existing_base->n_intermediate_bases > new_base.n_intermediate_bases
+    ) {
+        *i_existing_base = new_base;
+    } else if (
+        i_existing_base->n_intermediate_bases == new_base.n_intermediate_bases
+    ) {
+        i_existing_base->offset = error_ambiguous_base;
+    }
 }
 
 APOLLO_API apollo::detail::class_info
@@ -138,27 +325,21 @@ apollo::detail::make_class_info_impl(
         auto const base_offset = // Ugly hack, but hardly replaceable
             static_cast<char*>(base.cast(reinterpret_cast<void*>(1))) -
             reinterpret_cast<char*>(1);
-        info.bases[base.type->static_id] = {base_offset, 0};
+        add_base_relation(info.bases, {base.type->static_id, base_offset, 0});
         for (auto& indirect_base: base.type->bases) {
-            auto offset = base_offset + indirect_base.second.offset;
-            auto n_intermediate_bases =
-                indirect_base.second.n_intermediate_bases + 1;
-            auto i_existing_base = info.bases.find(indirect_base.first);
-            if (i_existing_base == info.bases.end()) {
-                info.bases.insert({indirect_base.first,
-                    {offset, n_intermediate_bases}});
-            } else if (
-                i_existing_base->second.n_intermediate_bases >
-                indirect_base.second.n_intermediate_bases
-            ) {
-                i_existing_base->second = {offset, n_intermediate_bases};
-            } else if (
-                i_existing_base->second.n_intermediate_bases ==
-                indirect_base.second.n_intermediate_bases
-            ) {
-                i_existing_base->second.offset = error_ambiguous_base;
-            }
+            auto offset = indirect_base.offset == error_ambiguous_base ?
+                error_ambiguous_base : base_offset + indirect_base.offset;
+            add_base_relation(info.bases, {
+                indirect_base.static_id,
+                offset,
+                indirect_base.n_intermediate_bases + 1});
         }
     }
+    std::sort(info.bases.begin(), info.bases.end(),
+        [](class_info::base_relation const& lhs,
+           class_info::base_relation const& rhs) {
+            return lhs.static_id < rhs.static_id;
+        });
+    info.bases.shrink_to_fit();
     return info;
 }
@@ -2,28 +2,170 @@
 // This file is subject to the terms of the BSD 2-Clause License.
 // See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
 
+#include <apollo/batched_function.hpp>
 #include <apollo/function.hpp>
-#include <apollo/detail/light_key.hpp>
-#include <apollo/stack_balance.hpp>
 
-static apollo::detail::light_key function_tag = {};
+#include <boost/exception/errinfo_type_info_name.hpp>
+#include <boost/throw_exception.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace {
+
+// The entry points of the functions pushed by apollo (the lua_CFunctions of
+// their closures) are stored in an open addressing hash table, which tells
+// apollo's closures apart from other C functions without accessing upvalues.
+// The function type itself is stored in the fn_upval_type upvalue: entry
+// points are usually distinct for each function type, but identical code
+// folding (e.g. MSVC's /OPT:ICF or --icf=all) can merge the entry points of
+// different types, such as long(*)(long) and long long(*)(long long).
+// As with the class ID table in class_info.cpp, the table is only modified
+// while holding function_type_mutex(), but can be read without locking: slots
+// are published atomically, and old tables are kept alive.
+struct function_entry_table {
+    explicit function_entry_table(std::size_t capacity_)
+        : capacity(capacity_)
+        , slots(new std::atomic<lua_CFunction>[capacity_])
+    {
+        BOOST_ASSERT((capacity & (capacity - 1)) == 0); // Power of two.
+        for (std::size_t i = 0; i < capacity; ++i)
+            slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    std::size_t capacity;
+    std::unique_ptr<std::atomic<lua_CFunction>[]> slots;
+    std::unique_ptr<function_entry_table> previous;
+};
+
+std::size_t const min_function_entry_capacity = 64;
+
+std::size_t entry_point_hash(lua_CFunction f)
+{
+    // Functions are usually aligned, so the lowest bits carry no information.
+    return static_cast<std::size_t>(reinterpret_cast<std::uintptr_t>(f) >> 4);
+}
+
+bool has_entry_point(function_entry_table const& table, lua_CFunction f)
+{
+    std::size_t const mask = table.capacity - 1;
+    for (std::size_t i = entry_point_hash(f) & mask;; i = (i + 1) & mask) {
+        auto const entry_point = table.slots[i].load(
+            std::memory_order_acquire);
+        if (!entry_point)
+            return false;
+        if (entry_point == f)
+            return true;
+    }
+}
+
+// Precondition: f is not in table and table has a free slot.
+void insert_entry_point(function_entry_table& table, lua_CFunction f)
+{
+    std::size_t const mask = table.capacity - 1;
+    std::size_t i = entry_point_hash(f) & mask;
+    while (table.slots[i].load(std::memory_order_relaxed))
+        i = (i + 1) & mask;
+    table.slots[i].store(f, std::memory_order_release);
+}
+
+std::mutex& function_type_mutex()
+{
+#ifdef BOOST_CLANG
+#    pragma clang diagnostic push
+#    pragma clang diagnostic ignored "-Wexit-time-destructors"
+#endif
+    static std::mutex mutex;
+#ifdef BOOST_CLANG
+#    pragma clang diagnostic pop
+#endif
+    return mutex;
+}
+
+std::atomic<function_entry_table*>& current_function_entry_table()
+{
+    static std::atomic<function_entry_table*> table(nullptr);
+    return table;
+}
+
+} // anonymous namespace
 
 APOLLO_API boost::typeindex::type_info const& apollo::detail::function_type(
     lua_State* L, int idx)
 {
-    stack_balance b(L);
-
-    if (!lua_getupvalue(L, idx, fn_upval_tag))
+    lua_CFunction const f = lua_tocfunction(L, idx);
+    function_entry_table const* const table =
+        current_function_entry_table().load(std::memory_order_acquire);
+    if (!f || !table || !has_entry_point(*table, f))
         return boost::typeindex::type_id<void>().type_info();
-    if (lua_touserdata(L, -1) != function_tag)
-        return boost::typeindex::type_id<void>().type_info();
-    lua_pop(L, 1); // Necessary to keep idx correct:
     BOOST_VERIFY(lua_getupvalue(L, idx, fn_upval_type));
-    return *static_cast<boost::typeindex::type_info const*>(
+    auto const type = static_cast<boost::typeindex::type_info const*>(
         lua_touserdata(L, -1));
+    lua_pop(L, 1);
+    BOOST_ASSERT(type);
+    return *type;
+}
+
+APOLLO_API lua_CFunction apollo::detail::register_function_entry_point(
+    lua_CFunction entry_point)
+{
+    std::lock_guard<std::mutex> lock(function_type_mutex());
+#ifdef BOOST_CLANG
+#    pragma clang diagnostic push
+#    pragma clang diagnostic ignored "-Wexit-time-destructors"
+#endif
+    static std::unique_ptr<function_entry_table> owned_table;
+#ifdef BOOST_CLANG
+#    pragma clang diagnostic pop
+#endif
+    static std::size_t n_entry_points = 0;
+
+    function_entry_table* table = owned_table.get();
+    if (table && has_entry_point(*table, entry_point))
+        return entry_point; // Another type with the same (folded) code.
+
+    // Keep the load factor at most 1/2.
+    if (!table || (n_entry_points + 1) * 2 > table->capacity) {
+        std::unique_ptr<function_entry_table> new_table(
+            new function_entry_table(table ?
+                table->capacity * 2 : min_function_entry_capacity));
+        if (table) {
+            for (std::size_t i = 0; i < table->capacity; ++i) {
+                auto f = table->slots[i].load(std::memory_order_relaxed);
+                if (f)
+                    insert_entry_point(*new_table, f);
+            }
+        }
+        new_table->previous = std::move(owned_table);
+        owned_table = std::move(new_table);
+        table = owned_table.get();
+        current_function_entry_table().store(table, std::memory_order_release);
+    }
+
+    insert_entry_point(*table, entry_point);
+    ++n_entry_points;
+    return entry_point;
 }
 
-APOLLO_API void apollo::detail::push_function_tag(lua_State* L)
+APOLLO_API int apollo::detail::batch_size(lua_State* L, int n_args)
 {
-    lua_pushlightuserdata(L, function_tag);
+    int n_calls = -1;
+    for (int i = 1; i <= n_args; ++i) {
+        if (lua_type(L, i) != LUA_TTABLE)
+            continue;
+        int const len = static_cast<int>(lua_rawlen(L, i));
+        if (n_calls == -1) {
+            n_calls = len;
+        } else if (len != n_calls) {
+            BOOST_THROW_EXCEPTION(to_cpp_conversion_error()
+                << errinfo::msg("batch tables differ in length")
+                << errinfo::stack_index(i)
+                << boost::errinfo_type_info_name(
+                    "table of length " + std::to_string(n_calls)));
+        }
+    }
+    return n_calls == -1 ? 1 : n_calls; // Only scalars: call once.
 }
@@ -30,18 +30,23 @@ APOLLO_API bool push_error_msg_handler(lua_State* L)
     return true;
 }
 
+APOLLO_API BOOST_NORETURN void detail::throw_pcall_error(
+    lua_State* L, int r)
+{
+    auto lua_msg = to(L, -1, std::string("(no error message)"));
+    lua_pop(L, 1);
+    BOOST_THROW_EXCEPTION(lua_api_error()
+                          << errinfo::lua_state(L)
+                          << errinfo::lua_msg(lua_msg)
+                          << errinfo::lua_error_code(r)
+                          << errinfo::msg("lua_pcall() failed"));
+}
+
 APOLLO_API void pcall(lua_State* L, int nargs, int nresults, int msgh)
 {
     int const r = lua_pcall(L, nargs, nresults, msgh);
-    if (r != LUA_OK) {
-        auto lua_msg = to(L, -1, std::string("(no error message)"));
-        lua_pop(L, 1);
-        BOOST_THROW_EXCEPTION(lua_api_error()
-                              << errinfo::lua_state(L)
-                              << errinfo::lua_msg(lua_msg)
-                              << errinfo::lua_error_code(r)
-                              << errinfo::msg("lua_pcall() failed"));
-    }
+    if (r != LUA_OK)
+        detail::throw_pcall_error(L, r);
 }
 
 APOLLO_API void pcall(lua_State* L, int nargs, int nresults)
@@ -0,0 +1,211 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include <apollo/memory_pool.hpp>
+
+#include <boost/assert.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+namespace {
+
+std::size_t const chunk_size = 16 * 1024;
+
+// Chunks start with their header, padded so that blocks stay aligned.
+std::size_t const chunk_header_size = apollo::memory_pool::granularity;
+
+inline bool is_pooled(std::size_t size)
+{
+    return size <= apollo::memory_pool::max_pooled_size;
+}
+
+// Precondition: 0 < size <= max_pooled_size
+inline std::size_t size_class(std::size_t size)
+{
+    return (size - 1) / apollo::memory_pool::granularity;
+}
+
+int panic(lua_State* L)
+{
+    char const* msg = lua_tostring(L, -1);
+    std::fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n",
+        msg ? msg : "error object is not a string");
+    return 0; // Return to Lua to abort.
+}
+
+} // anonymous namespace
+
+APOLLO_API apollo::memory_pool::memory_pool(std::size_t max_bytes)
+    : m_chunks(nullptr)
+    , m_n_bytes(0)
+    , m_n_blocks(0)
+    , m_n_chunks(0)
+    , m_n_foreign_blocks(0)
+    , m_max_bytes(max_bytes)
+    , m_chunk_alloc(&std::malloc)
+{
+    static_assert(sizeof(chunk) <= chunk_header_size,
+        "chunk header does not fit into its padding.");
+    m_free_lists.fill(nullptr);
+}
+
+APOLLO_API apollo::memory_pool::~memory_pool()
+{
+    while (m_chunks) {
+        chunk* next = m_chunks->next;
+        std::free(m_chunks);
+        m_chunks = next;
+    }
+}
+
+APOLLO_API void* apollo::memory_pool::lua_alloc(
+    void* ud, void* ptr, std::size_t osize, std::size_t nsize) BOOST_NOEXCEPT
+{
+    auto& pool = *static_cast<memory_pool*>(ud);
+    if (!ptr)
+        osize = 0; // Lua >= 5.2 passes the type of the new object as osize.
+
+    if (nsize == 0) {
+        if (ptr)
+            pool.deallocate(ptr, osize);
+        return nullptr;
+    }
+
+    if (nsize > osize
+        && pool.m_max_bytes != 0
+        && pool.m_n_bytes + (nsize - osize) > pool.m_max_bytes
+    ) {
+        return nullptr;
+    }
+
+    return ptr ? pool.reallocate(ptr, osize, nsize) : pool.allocate(nsize);
+}
+
+APOLLO_API lua_State* apollo::memory_pool::new_state()
+{
+    lua_State* L = lua_newstate(&memory_pool::lua_alloc, this);
+    if (L)
+        lua_atpanic(L, &panic);
+    return L;
+}
+
+void* apollo::memory_pool::allocate(std::size_t size) BOOST_NOEXCEPT
+{
+    void* p;
+    if (is_pooled(size)) {
+        std::size_t const cls = size_class(size);
+        if (!m_free_lists[cls] && !refill(cls))
+            return nullptr;
+        free_block* block = m_free_lists[cls];
+        m_free_lists[cls] = block->next;
+        p = block;
+    } else {
+        p = std::malloc(size);
+        if (!p)
+            return nullptr;
+    }
+    m_n_bytes += size;
+    ++m_n_blocks;
+    return p;
+}
+
+void apollo::memory_pool::deallocate(void* p, std::size_t size) BOOST_NOEXCEPT
+{
+    BOOST_ASSERT(m_n_blocks > 0 && m_n_bytes >= size);
+    if (is_pooled(size) && m_n_foreign_blocks != 0 && !is_chunk_block(p)) {
+        --m_n_foreign_blocks;
+        std::free(p);
+    } else if (is_pooled(size)) {
+        auto block = static_cast<free_block*>(p);
+        std::size_t const cls = size_class(size);
+        block->next = m_free_lists[cls];
+        m_free_lists[cls] = block;
+    } else {
+        std::free(p);
+    }
+    m_n_bytes -= size;
+    --m_n_blocks;
+}
+
+void* apollo::memory_pool::reallocate(
+    void* p, std::size_t osize, std::size_t nsize) BOOST_NOEXCEPT
+{
+    if (is_pooled(osize) && is_pooled(nsize)
+        && size_class(osize) == size_class(nsize)
+    ) {
+        m_n_bytes = m_n_bytes - osize + nsize;
+        return p;
+    }
+
+    if (!is_pooled(osize) && !is_pooled(nsize)) {
+        void* np = std::realloc(p, nsize);
+        if (!np) {
+            if (nsize >= osize)
+                return nullptr;
+            np = p; // Shrinking must not fail; keep the bigger block.
+        }
+        m_n_bytes = m_n_bytes - osize + nsize;
+        return np;
+    }
+
+    void* np = allocate(nsize);
+    if (!np) {
+        // Lua assumes that shrinking never fails. The old block is at least as
+        // big as required, so just keep it. If it came from std::malloc(),
+        // deallocate() has to give it back to std::free() instead of putting
+        // it into a free list.
+        if (nsize < osize) {
+            if (!is_pooled(osize))
+                ++m_n_foreign_blocks;
+            m_n_bytes = m_n_bytes - osize + nsize;
+            return p;
+        }
+        return nullptr;
+    }
+    std::memcpy(np, p, std::min(osize, nsize));
+    deallocate(p, osize);
+    return np;
+}
+
+bool apollo::memory_pool::refill(std::size_t cls) BOOST_NOEXCEPT
+{
+    BOOST_ASSERT(!m_free_lists[cls]);
+    auto c = static_cast<chunk*>(m_chunk_alloc(chunk_size));
+    if (!c)
+        return false;
+    c->next = m_chunks;
+    m_chunks = c;
+    ++m_n_chunks;
+
+    std::size_t const block_size = (cls + 1) * granularity;
+    char* const first = reinterpret_cast<char*>(c) + chunk_header_size;
+    std::size_t const n_blocks = (chunk_size - chunk_header_size) / block_size;
+    free_block* next = nullptr;
+    for (std::size_t i = n_blocks; i > 0; --i) {
+        auto block = reinterpret_cast<free_block*>(
+            first + (i - 1) * block_size);
+        block->next = next;
+        next = block;
+    }
+    m_free_lists[cls] = next;
+    return true;
+}
+
+bool apollo::memory_pool::is_chunk_block(void const* p) const BOOST_NOEXCEPT
+{
+    // Only called while there are foreign blocks, i.e. after the system ran
+    // out of memory, so a linear search is fine.
+    std::less<char const*> const less;
+    auto const block = static_cast<char const*>(p);
+    for (chunk const* c = m_chunks; c; c = c->next) {
+        auto const begin = reinterpret_cast<char const*>(c);
+        if (!less(block, begin) && less(block, begin + chunk_size))
+            return true;
+    }
+    return false;
+}
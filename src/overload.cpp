@@ -2,18 +2,144 @@
 // This file is subject to the terms of the BSD 2-Clause License.
 // See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
 
+#include <apollo/class.hpp>
 #include <apollo/overload.hpp>
 
+#include <array>
+#include <atomic>
+
 //#include <iostream>
 
 namespace {
 
-using apollo::detail::overload;
 using apollo::detail::overload_base;
 using apollo::detail::overload_quality;
-using ovl_with_quality = std::pair<overload_base*, overload_quality>;
 using overload_vec = apollo::detail::overloadset::vec;
 
+// Calls with more arguments are always resolved from scratch.
+std::size_t const max_cached_args = 8;
+std::size_t const n_cache_entries = 4;
+
+// Everything that n_conversion_steps() of type determined converters may
+// depend on.
+struct arg_signature {
+    int type; // lua_type() or-ed with the arg_* flags below.
+    void const* cls; // class_info of apollo instances.
+    void const* holder_type; // Dynamic type of the instance_holder.
+};
+
+int const
+    arg_integer = 1 << 4,
+    arg_numeric_string = 1 << 5,
+    arg_const_instance = 1 << 6,
+    arg_null_instance = 1 << 7;
+
+bool operator== (arg_signature const& lhs, arg_signature const& rhs)
+{
+    return lhs.type == rhs.type
+        && lhs.cls == rhs.cls
+        && lhs.holder_type == rhs.holder_type;
+}
+
+static void get_arg_signature(lua_State* L, int idx, arg_signature& sig)
+{
+    using namespace apollo::detail;
+    sig.type = lua_type(L, idx);
+    sig.cls = nullptr;
+    sig.holder_type = nullptr;
+    switch (sig.type) {
+        case LUA_TNUMBER:
+#if LUA_VERSION_NUM >= 503
+            if (lua_isinteger(L, idx))
+                sig.type |= arg_integer;
+#endif // LUA_VERSION_NUM >= 503
+            break;
+        case LUA_TSTRING:
+            if (lua_isnumber(L, idx))
+                sig.type |= arg_numeric_string;
+            break;
+        case LUA_TUSERDATA:
+            if (is_apollo_instance(L, idx)) {
+                auto const& header = *as_header(L, idx);
+                sig.cls = header.cls;
+                sig.holder_type = &boost::typeindex::type_id_runtime(
+                    *header.holder).type_info();
+                if (header.is_const)
+                    sig.type |= arg_const_instance;
+                if (!instance_object(header))
+                    sig.type |= arg_null_instance;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Incremented by invalidate_overload_caches().
+std::atomic<unsigned> overload_cache_generation(0);
+
+struct resolution_cache_entry {
+    int n_args; // -1 if the entry is unused.
+    std::size_t overload_idx;
+    std::array<arg_signature, max_cached_args> args;
+};
+
+// The state of an overload set after it has been pushed. All memory needed
+// for overload resolution is allocated up front, so that calls do not have to
+// touch the heap.
+struct overload_dispatcher {
+    explicit overload_dispatcher(overload_vec&& overloads_)
+        : overloads(std::move(overloads_))
+        , max_arity(0)
+        , qualities(overloads.size())
+        , best(overloads.size())
+        , cache_enabled(true)
+        , cache_generation(
+            overload_cache_generation.load(std::memory_order_relaxed))
+        , next_cache_entry(0)
+        , n_hits(0)
+        , n_misses(0)
+    {
+        for (auto& ovl: overloads) {
+            max_arity = std::max(max_arity, ovl->arity());
+            cache_enabled = cache_enabled && ovl->is_type_determined();
+        }
+        steps_storage.resize(overloads.size() * max_arity);
+        for (auto& entry: cache)
+            entry.n_args = -1;
+    }
+
+    overload_dispatcher(overload_dispatcher&& other)
+        : overloads(std::move(other.overloads))
+        , max_arity(other.max_arity)
+        , steps_storage(std::move(other.steps_storage))
+        , qualities(std::move(other.qualities))
+        , best(std::move(other.best))
+        , cache_enabled(other.cache_enabled)
+        , cache_generation(other.cache_generation)
+        , cache(other.cache)
+        , next_cache_entry(other.next_cache_entry)
+        , n_hits(other.n_hits)
+        , n_misses(other.n_misses)
+    {}
+
+    overload_vec overloads;
+    std::size_t max_arity;
+
+    // Scratch space used during overload resolution:
+    std::vector<unsigned> steps_storage; // overloads.size() * max_arity
+    std::vector<overload_quality> qualities; // One per overload.
+    std::vector<std::size_t> best; // Indices of best overloads.
+
+    // Resolution cache:
+    bool cache_enabled;
+    unsigned cache_generation; // The cache is valid for this generation.
+    std::array<resolution_cache_entry, n_cache_entries> cache;
+    std::size_t next_cache_entry; // Entries are replaced round-robin.
+    unsigned long n_hits;
+    unsigned long n_misses;
+};
+
 
 // Precondition: lhs and rhs must be viable.
 static bool is_better_overload(
@@ -21,8 +147,7 @@ static bool is_better_overload(
 {
     if (lhs.n_lua_args_consumed < rhs.n_lua_args_consumed)
         return false;
-    auto const n = std::min(
-        lhs.param_conversion_steps.size(), rhs.param_conversion_steps.size());
+    auto const n = std::min(lhs.n_params, rhs.n_params);
 
     bool lhs_has_better =
         lhs.n_lua_args_consumed > rhs.n_lua_args_consumed;
@@ -38,90 +163,128 @@ static bool is_better_overload(
     return lhs_has_better;
 }
 
-static std::vector<ovl_with_quality> select_best_overloads(
-    lua_State* L, overload_vec& overloads)
+// Returns the number of best overloads, whose indices are stored at the
+// beginning of d.best.
+static std::size_t select_best_overloads(
+    lua_State* L, overload_dispatcher& d)
 {
-    std::vector<ovl_with_quality> best;
+    std::size_t n_best = 0;
+    std::size_t* const best = d.best.data();
 
-    for (auto& ovl: overloads) {
-        auto quality = ovl->calculate_quality(L);
+    for (std::size_t i = 0; i < d.overloads.size(); ++i) {
+        auto& ovl = *d.overloads[i];
+        auto& quality = d.qualities[i];
+        unsigned* steps = d.steps_storage.data() + i * d.max_arity;
+        quality.param_conversion_steps = steps;
+        quality.n_params = ovl.arity();
+        quality.n_lua_args_consumed = ovl.calculate_quality(L, steps);
         bool is_viable = std::find(
-                quality.param_conversion_steps.begin(),
-                quality.param_conversion_steps.end(),
-                apollo::no_conversion)
-            == quality.param_conversion_steps.end();
+                steps, steps + quality.n_params, apollo::no_conversion)
+            == steps + quality.n_params;
         if (!is_viable)
             continue;
 
         //std::cout << "Viable: ";
-        //ovl->push_signature(L);
+        //ovl.push_signature(L);
         //std::cout << lua_tostring(L, -1) << "\n";
         //lua_pop(L, 1);
 
-        auto n_better = static_cast<std::size_t>(std::count_if(
-            best.begin(), best.end(),
-            [quality](ovl_with_quality const& elem) {
-                return is_better_overload(quality, elem.second);
-            }));
-
-        if (n_better == best.size()) { // Automatically handles empty best.
-            best.clear();
-            best.emplace_back(ovl.get(), std::move(quality));
-            //puts("Cleared viables, because this one is better.");
-        } else if (n_better > 0) {
-            best.emplace_back(ovl.get(), std::move(quality));
-        } else {
-            if (
-                best.end() == std::find_if(
-                    best.begin(), best.end(),
-                    [quality](ovl_with_quality const& elem) {
-                        return is_better_overload(elem.second, quality);
-                    })
-               ) {
-                best.emplace_back(ovl.get(), std::move(quality));
-            }
+        n_best = apollo::detail::update_best_overloads(
+            d.qualities.data(), best, n_best, i);
+    }
+    //std::cout << n_best << " candidates selected.\n";
+    return n_best;
+}
+
+// Pushes the message for a failed overload resolution: a list of all
+// overloads if n_candidates is zero, else a list of the ambiguous candidates.
+// push_signature(L, i) must push the signature of the i-th overload.
+template <typename PushSignature>
+void push_overload_error(
+    lua_State* L, PushSignature push_signature, std::size_t n_overloads,
+    std::size_t const* candidates, std::size_t n_candidates)
+{
+    if (n_candidates == 0) {
+        lua_checkstack(L, static_cast<int>(1 + n_overloads * 3));
+        lua_pushliteral(
+            L,
+            "No overload is viable for the given arguments. Overloads:\n");
+        for (std::size_t i = 0; i < n_overloads; ++i) {
+            lua_pushliteral(L, "  ");
+            push_signature(L, i);
+            lua_pushliteral(L, "\n");
         }
+        lua_concat(L, static_cast<int>(1 + n_overloads * 3));
+    } else {
+        lua_checkstack(L, static_cast<int>(2 + n_candidates * 3));
+        lua_pushliteral(
+            L, "Ambiguous call to overloaded function, candidates:\n");
+        for (std::size_t i = 0; i < n_candidates; ++i) {
+            lua_pushliteral(L, "  ");
+            push_signature(L, candidates[i]);
+            lua_pushliteral(L, "\n");
+        }
+        lua_pushfstring(L, "  (in total, %d candidates of %d overloads)",
+            static_cast<int>(n_candidates),
+            static_cast<int>(n_overloads));
+        lua_concat(L, static_cast<int>(2 + n_candidates * 3));
     }
-    //std::cout << best.size() << " candidates selected.\n";
-    return best;
 }
 
 int dispatch_overload(lua_State* L)
 {
     overload_base* f = nullptr;
     {
-        auto& overloads = *static_cast<overload_vec*>(
+        auto& d = *static_cast<overload_dispatcher*>(
             lua_touserdata(L, lua_upvalueindex(1)));
+        auto& overloads = d.overloads;
         BOOST_ASSERT(!overloads.empty());
 
-        auto candidates = select_best_overloads(L, overloads);
+        int const n_args = lua_gettop(L);
+        bool const use_cache = d.cache_enabled
+            && static_cast<std::size_t>(n_args) <= max_cached_args;
+        std::array<arg_signature, max_cached_args> args;
+        if (use_cache) {
+            unsigned const generation =
+                overload_cache_generation.load(std::memory_order_relaxed);
+            if (generation != d.cache_generation) {
+                for (auto& entry: d.cache)
+                    entry.n_args = -1;
+                d.cache_generation = generation;
+            }
+            for (int i = 0; i < n_args; ++i)
+                get_arg_signature(L, i + 1, args[static_cast<std::size_t>(i)]);
+            for (auto& entry: d.cache) {
+                if (entry.n_args == n_args
+                    && std::equal(args.begin(), args.begin() + n_args,
+                                  entry.args.begin())
+                ) {
+                    ++d.n_hits;
+                    return overloads[entry.overload_idx]->invoke(L);
+                }
+            }
+        }
+        if (d.cache_enabled)
+            ++d.n_misses;
 
-        if (candidates.size() == 1) {
-            f = candidates.front().first;
-        } else if (candidates.empty()) {
-            lua_checkstack(L, static_cast<int>(1 + overloads.size() * 3));
-            lua_pushliteral(
-                L,
-                "No overload is viable for the given arguments. Overloads:\n");
-            for (auto& c: overloads) {
-                lua_pushliteral(L, "  ");
-                c->push_signature(L);
-                lua_pushliteral(L, "\n");
+        auto const n_candidates = select_best_overloads(L, d);
+
+        if (n_candidates == 1) {
+            f = overloads[d.best.front()].get();
+            if (use_cache) {
+                auto& entry = d.cache[d.next_cache_entry];
+                d.next_cache_entry = (d.next_cache_entry + 1) % n_cache_entries;
+                entry.n_args = n_args;
+                entry.overload_idx = d.best.front();
+                std::copy_n(args.begin(), n_args, entry.args.begin());
             }
-            lua_concat(L, static_cast<int>(1 + overloads.size() * 3));
         } else {
-            lua_checkstack(L, static_cast<int>(2 + overloads.size() * 3));
-            lua_pushliteral(
-                L, "Ambiguous call to overloaded function, candidates:\n");
-            for (auto& c: candidates) {
-                lua_pushliteral(L, "  ");
-                c.first->push_signature(L);
-                lua_pushliteral(L, "\n");
-            }
-            lua_pushfstring(L, "  (in total, %d candidates of %d overloads)",
-                static_cast<int>(candidates.size()),
-                static_cast<int>(overloads.size()));
-            lua_concat(L, static_cast<int>(2 + candidates.size() * 3));
+            push_overload_error(
+                L,
+                [&overloads](lua_State* L_, std::size_t i) {
+                    overloads[i]->push_signature(L_);
+                },
+                overloads.size(), d.best.data(), n_candidates);
         }
     }
     if (f)
@@ -131,8 +294,69 @@ int dispatch_overload(lua_State* L)
 
 } // anonymous namespace
 
+APOLLO_API std::size_t apollo::detail::update_best_overloads(
+    overload_quality const* qualities,
+    std::size_t* best, std::size_t n_best,
+    std::size_t idx)
+{
+    auto& quality = qualities[idx];
+    auto n_better = static_cast<std::size_t>(std::count_if(
+        best, best + n_best,
+        [qualities, &quality](std::size_t elem) {
+            return is_better_overload(quality, qualities[elem]);
+        }));
+
+    if (n_better == n_best) { // Automatically handles empty best.
+        //puts("Cleared viables, because this one is better.");
+        best[0] = idx;
+        return 1;
+    }
+    if (n_better > 0
+        || best + n_best == std::find_if(
+            best, best + n_best,
+            [qualities, &quality](std::size_t elem) {
+                return is_better_overload(qualities[elem], quality);
+            })
+    ) {
+        best[n_best++] = idx;
+    }
+    return n_best;
+}
+
+APOLLO_API void apollo::detail::push_static_overload_error(
+    lua_State* L, void (* const* push_signatures)(lua_State*),
+    std::size_t n_overloads,
+    std::size_t const* candidates, std::size_t n_candidates)
+{
+    push_overload_error(
+        L,
+        [push_signatures](lua_State* L_, std::size_t i) {
+            push_signatures[i](L_);
+        },
+        n_overloads, candidates, n_candidates);
+}
+
 APOLLO_API void apollo::detail::overloadset::push(lua_State* L)
 {
-    push_gc_object(L, std::move(m_overloads));
+    push_gc_object(L, overload_dispatcher(std::move(m_overloads)));
     lua_pushcclosure(L, raw_function::caught<&dispatch_overload>(), 1);
 }
+
+APOLLO_API void apollo::detail::invalidate_overload_caches() BOOST_NOEXCEPT
+{
+    overload_cache_generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+APOLLO_API apollo::overload_cache_stats apollo::get_overload_cache_stats(
+    lua_State* L, int idx)
+{
+    if (lua_tocfunction(L, idx) != raw_function::caught<&dispatch_overload>()
+        || !lua_getupvalue(L, idx, 1)
+    ) {
+        BOOST_THROW_EXCEPTION(to_cpp_conversion_error()
+            << errinfo::msg("Value is not an overload set."));
+    }
+    auto& d = *static_cast<overload_dispatcher*>(lua_touserdata(L, -1));
+    lua_pop(L, 1);
+    return {d.cache_enabled, d.n_hits, d.n_misses};
+}
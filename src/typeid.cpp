@@ -36,6 +36,6 @@ APOLLO_API boost::typeindex::type_info const& apollo::ltypeid(
     lua_State* L, int idx)
 {
     if (detail::is_apollo_instance(L, idx))
-        return *detail::as_holder(L, idx)->type().rtti_type;
+        return *detail::as_header(L, idx)->cls->rtti_type;
     return lbuiltin_typeid(lua_type(L, idx));
 }
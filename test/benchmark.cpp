@@ -2,14 +2,39 @@
 // This file is subject to the terms of the BSD 2-Clause License.
 // See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
 
+#include <cstdlib>
 #include <ctime>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <vector>
+
+#ifdef __linux__
+#   include <unistd.h>
+#endif
 
 #include <apollo/to_raw_function.hpp>
+#include <apollo/array_view.hpp>
+#if LUA_VERSION_NUM >= 502
+#    include <apollo/async_result.hpp>
+#endif
+#include <apollo/batched_function.hpp>
 #include <apollo/function.hpp>
 #include <apollo/builtin_types.hpp>
 #include <apollo/emplace_ctor.hpp>
 #include <apollo/create_table.hpp>
+#include <apollo/class.hpp>
+#include <apollo/gc.hpp>
+#include <apollo/lapi.hpp>
+#include <apollo/lua_callable.hpp>
+#include <apollo/map_converters.hpp>
+#include <apollo/memory_pool.hpp>
+#include <apollo/optional_converters.hpp>
+#include <apollo/property.hpp>
+#include <apollo/sequence_converters.hpp>
+#include <apollo/tuple_converters.hpp>
+
+#include <boost/function.hpp>
 
 namespace {
 
@@ -32,11 +57,989 @@ inline double clocks_to_seconds(std::clock_t c)
     return static_cast<double>(c) / CLOCKS_PER_SEC;
 }
 
+// Returns the shortest time of 5 runs of run().
+template <typename F>
+std::clock_t best_of_5_runs(F const& run)
+{
+    std::clock_t best = 0;
+    for (int i = 0; i < 5; ++i) {
+        std::clock_t const start = std::clock();
+        run();
+        std::clock_t const time = std::clock() - start;
+        if (i == 0 || time < best)
+            best = time;
+    }
+    return best;
+}
+
+// Best time of 5 runs of n_calls calls f(i), in ns per call.
+template <typename F>
+double bench_callback(F const& f, int n_calls)
+{
+    long long checksum = 0;
+    std::clock_t const best = best_of_5_runs([&f, &checksum, n_calls]() {
+        for (int i = 0; i < n_calls; ++i)
+            checksum += f(i);
+    });
+    if (checksum == 42) // Practically impossible; keeps the loop alive.
+        std::cout << '\n';
+    return clocks_to_seconds(best) * 1000000000 / n_calls;
+}
+
+// Best time of 5 runs of the Lua chunk loop, in ns per iteration if it
+// does 1000000 iterations.
+double bench_lua_loop(lua_State* L, char const* loop)
+{
+    std::clock_t const best = best_of_5_runs([L, loop]() {
+        if (luaL_dostring(L, loop) != 0) {
+            std::cerr << lua_tostring(L, -1) << '\n';
+            std::exit(EXIT_FAILURE);
+        }
+    });
+    return clocks_to_seconds(best) * 1000000000 / 1000000;
+}
+
+// Pushes num_pushes objects of type A, in batches so that the stack and the GC
+// do not dominate the measurement.
+std::clock_t bench_push(lua_State* L, int num_pushes)
+{
+    A a;
+    int const batch_size = 100;
+    lua_checkstack(L, batch_size);
+    std::clock_t start = std::clock();
+    for (int i = 0; i < num_pushes / batch_size; ++i) {
+        for (int j = 0; j < batch_size; ++j)
+            apollo::push(L, &a);
+        lua_pop(L, batch_size);
+    }
+    return std::clock() - start;
+}
+
+// Class hierarchies for the cast benchmarks: level<N> derives (indirectly) from
+// level<0> via N intermediate classes.
+template <int N>
+struct level: level<N - 1> {
+    int n;
+};
+
+template <>
+struct level<0> {
+    int n;
+};
+
+void register_levels(lua_State* L, std::integral_constant<int, 0>)
+{
+    apollo::register_class<level<0>>(L);
+}
+
+template <int N>
+void register_levels(lua_State* L, std::integral_constant<int, N>)
+{
+    register_levels(L, std::integral_constant<int, N - 1>());
+    apollo::register_class<level<N>, level<N - 1>>(L);
+}
+
+struct mi_a { int a; };
+struct mi_b { int b; };
+struct mi_c { int c; };
+struct mi_d { int d; };
+struct mi_derived: mi_a, mi_b, mi_c, mi_d { int e; };
+
+// Converts an object of type Derived to Base* num_casts times, once through the
+// converters and once by using only the class' cast table.
+template <typename Derived, typename Base>
+void bench_cast(lua_State* L, char const* name, int num_casts)
+{
+    Derived obj;
+    apollo::push(L, &obj);
+    std::clock_t start = std::clock();
+    for (int i = 0; i < num_casts; ++i) {
+        if (!apollo::is_convertible<Base*>(L, -1)
+            || !apollo::to<Base*>(L, -1)
+        ) {
+            std::cerr << "cast failed\n";
+        }
+    }
+    std::clock_t end = std::clock();
+    lua_pop(L, 1);
+
+    auto const& cls = apollo::detail::registered_class<Derived>(L);
+    std::size_t const base_id = apollo::detail::static_class_id<Base>::id;
+    std::clock_t start_table = std::clock();
+    for (int i = 0; i < num_casts; ++i) {
+        char const* err;
+        if (apollo::detail::n_class_conversion_steps(cls, base_id)
+                == apollo::no_conversion
+            || !apollo::detail::try_cast_class(&obj, cls, base_id, err)
+        ) {
+            std::cerr << "cast failed\n";
+        }
+    }
+    std::clock_t end_table = std::clock();
+
+    std::cout << name << ": "
+        << clocks_to_seconds(end - start) * 1000000000 / num_casts
+        << " nanoseconds per conversion, "
+        << clocks_to_seconds(end_table - start_table) * 1000000000 / num_casts
+        << " nanoseconds per table lookup\n";
+}
+
+void bench_casts(lua_State* L)
+{
+    register_levels(L, std::integral_constant<int, 10>());
+    apollo::register_class<mi_a>(L);
+    apollo::register_class<mi_b>(L);
+    apollo::register_class<mi_c>(L);
+    apollo::register_class<mi_d>(L);
+    apollo::register_class<mi_derived, mi_a, mi_b, mi_c, mi_d>(L);
+
+    int const num_casts = 10000000;
+    bench_cast<level<1>, level<0>>(L, "cast 1 level", num_casts);
+    bench_cast<level<3>, level<0>>(L, "cast 3 levels", num_casts);
+    bench_cast<level<10>, level<0>>(L, "cast 10 levels", num_casts);
+    bench_cast<level<10>, level<7>>(L, "cast 10 levels to 7", num_casts);
+    bench_cast<mi_derived, mi_c>(L, "cast multiple bases", num_casts);
+}
+
+// Checks num_checks times whether the value at the top of the stack is an
+// apollo instance (the check done for every object argument conversion).
+double bench_instance_check(lua_State* L, int num_checks)
+{
+    int n_instances = 0;
+    std::clock_t start = std::clock();
+    for (int i = 0; i < num_checks; ++i) {
+        if (apollo::detail::is_apollo_instance(L, -1))
+            ++n_instances;
+    }
+    std::clock_t end = std::clock();
+    if (n_instances != 0 && n_instances != num_checks)
+        std::cerr << "inconsistent instance check\n";
+    return clocks_to_seconds(end - start) * 1000000000 / num_checks;
+}
+
+void bench_instance_checks(lua_State* L)
+{
+    int const num_checks = 10000000;
+    A a;
+    apollo::push(L, &a);
+    std::cout << "instance check (instance): "
+        << bench_instance_check(L, num_checks) << " nanoseconds\n";
+    lua_pop(L, 1);
+    apollo::push_bare_udata(L, 42);
+    std::cout << "instance check (other userdata): "
+        << bench_instance_check(L, num_checks) << " nanoseconds\n";
+    lua_pop(L, 1);
+    lua_pushinteger(L, 42);
+    std::cout << "instance check (number): "
+        << bench_instance_check(L, num_checks) << " nanoseconds\n";
+    lua_pop(L, 1);
+}
+
+// lua_Alloc that counts the number of (re)allocations done by Lua.
+void* counting_alloc(void* ud, void* ptr, std::size_t, std::size_t nsize)
+{
+    if (nsize == 0) {
+        std::free(ptr);
+        return nullptr;
+    }
+    ++*static_cast<unsigned long*>(ud);
+    return std::realloc(ptr, nsize);
+}
+
+template <typename F>
+void bench_allocs(char const* name, F push_one)
+{
+    unsigned long n_allocs = 0;
+    lua_State* L = lua_newstate(&counting_alloc, &n_allocs);
+    int const num_pushes = 10000;
+    push_one(L); // Warm up, e.g. to create cached metatables.
+    lua_pop(L, 1);
+    lua_gc(L, LUA_GCSTOP, 0);
+    n_allocs = 0;
+    std::clock_t start = std::clock();
+    for (int i = 0; i < num_pushes; ++i) {
+        push_one(L);
+        lua_pop(L, 1);
+    }
+    std::clock_t end = std::clock();
+    std::cout << name << ": "
+        << static_cast<double>(n_allocs) / num_pushes << " allocations, "
+        << clocks_to_seconds(end - start) * 1000000000 / num_pushes
+        << " nanoseconds per push\n";
+    lua_close(L);
+}
+
+void bench_gc_allocs()
+{
+    bench_allocs("push_gc_object<std::string>", [](lua_State* L) {
+        apollo::push_gc_object(L, std::string("foo"));
+    });
+    bench_allocs("push std::function", [](lua_State* L) {
+        apollo::push(L, std::function<float(int, float, char const*, A*)>(
+            &f1));
+    });
+    bench_allocs("push bare udata", [](lua_State* L) {
+        apollo::push_bare_udata(L, 42);
+    });
+}
+
+// Pushes the same pointer num_pushes times (as e.g. event callbacks do) and
+// collects the resulting garbage.
+void bench_identity_cache(bool enabled)
+{
+    unsigned long n_allocs = 0;
+    lua_State* L = lua_newstate(&counting_alloc, &n_allocs);
+    apollo::register_class<A>(L);
+    if (enabled)
+        apollo::enable_identity_cache<A>(L);
+    A a;
+    apollo::push(L, &a); // Warm up.
+    lua_pop(L, 1);
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    lua_gc(L, LUA_GCSTOP, 0);
+    int const num_pushes = 100000;
+    n_allocs = 0;
+    std::clock_t start = std::clock();
+    for (int i = 0; i < num_pushes; ++i) {
+        apollo::push(L, &a);
+        lua_pop(L, 1);
+    }
+    std::clock_t const push_time = std::clock() - start;
+    start = std::clock();
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    std::clock_t const gc_time = std::clock() - start;
+    std::cout << "push A* (identity cache "
+        << (enabled ? "enabled" : "disabled") << "): "
+        << static_cast<double>(n_allocs) / num_pushes << " allocations, "
+        << clocks_to_seconds(push_time) * 1000000000 / num_pushes
+        << " nanoseconds per push, "
+        << clocks_to_seconds(gc_time) * 1000 << " milliseconds for GC\n";
+    lua_close(L);
+}
+
+// Runs workloads similar to the ones above on L and returns the time taken.
+std::clock_t run_alloc_workloads(lua_State* L)
+{
+    luaL_openlibs(L);
+    apollo::register_class<A>(L);
+    lua_pushglobaltable(L);
+    apollo::rawset_table(L, -1)
+        ("test1", APOLLO_TO_RAW_FUNCTION(&f1))
+        ("A", apollo::get_raw_emplace_ctor_wrapper<A>());
+    lua_pop(L, 1);
+
+    std::clock_t const start = std::clock();
+    luaL_dostring(L, "a = A()\n"
+                     "for i = 1, 100000 do\n"
+                     "  test1(5, 4.6, 'foo', a)\n"
+                     "  local t = {i, tostring(i), A()}\n"
+                     "end");
+    bench_push(L, 1000000);
+    for (int i = 0; i < 100000; ++i) {
+        apollo::push(L, &f1); // Pushes a closure.
+        lua_pop(L, 1);
+    }
+    return std::clock() - start;
+}
+
+struct counting_pool {
+    apollo::memory_pool pool;
+    unsigned long n_big_allocs; // Allocations not served by the pool.
+};
+
+void* counting_pool_alloc(
+    void* ud, void* ptr, std::size_t osize, std::size_t nsize)
+{
+    auto& c = *static_cast<counting_pool*>(ud);
+    if (nsize > apollo::memory_pool::max_pooled_size)
+        ++c.n_big_allocs;
+    return apollo::memory_pool::lua_alloc(&c.pool, ptr, osize, nsize);
+}
+
+void bench_memory_pool()
+{
+    unsigned long n_allocs = 0;
+    lua_State* L = lua_newstate(&counting_alloc, &n_allocs);
+    std::clock_t time = run_alloc_workloads(L);
+    lua_close(L);
+    std::cout << "workloads (default allocator): "
+        << n_allocs << " system allocations, "
+        << clocks_to_seconds(time) * 1000 << " milliseconds\n";
+
+    counting_pool c;
+    c.n_big_allocs = 0;
+    L = lua_newstate(&counting_pool_alloc, &c);
+    time = run_alloc_workloads(L);
+    lua_close(L);
+    std::cout << "workloads (memory_pool): "
+        << c.pool.n_chunks() + c.n_big_allocs << " system allocations, "
+        << clocks_to_seconds(time) * 1000 << " milliseconds\n";
+}
+
+struct counter {
+    int value;
+    void add(int n) { value += n; }
+};
+
+void bench_memfn_call(lua_State* L, char const* name)
+{
+    double const time = bench_lua_loop(L,
+        "local obj, add = obj, counter_add\n"
+        "for i = 1, 1000000 do add(obj, 1) end");
+    std::cout << "member function call (" << name << "): "
+        << time << " nanoseconds per call\n";
+}
+
+void bench_memfn_calls()
+{
+    lua_State* L = luaL_newstate();
+    apollo::register_class<counter>(L);
+    lua_pushcfunction(L, APOLLO_TO_RAW_FUNCTION(&counter::add));
+    lua_setglobal(L, "counter_add");
+
+    apollo::push(L, counter());
+    lua_setglobal(L, "obj");
+    bench_memfn_call(L, "value");
+
+    apollo::push(L, std::make_shared<counter>());
+    lua_setglobal(L, "obj");
+    bench_memfn_call(L, "std::shared_ptr");
+
+    counter c;
+    apollo::push(L, &c);
+    lua_setglobal(L, "obj");
+    bench_memfn_call(L, "raw pointer");
+    lua_close(L);
+}
+
+void bench_member_dispatch(char const* name, void (*setup)(lua_State*))
+{
+    lua_State* L = luaL_newstate();
+    apollo::register_class<counter>(L);
+    setup(L);
+    apollo::push(L, counter());
+    lua_setglobal(L, "obj");
+
+    double const read_time = bench_lua_loop(L,
+        "local obj, s = obj, 0\n"
+        "for i = 1, 1000000 do s = s + obj.value end");
+    double const call_time = bench_lua_loop(L,
+        "local obj = obj\n"
+        "for i = 1, 1000000 do obj:add(1) end");
+    std::cout << "member dispatch (" << name << "): property read: "
+        << read_time << " ns, method call: " << call_time << " ns\n";
+    lua_close(L);
+}
+
+int get_counter_value(counter const& c)
+{
+    return c.value;
+}
+
+// What had to be done before add_method() and add_property() existed.
+void setup_lua_index_glue(lua_State* L)
+{
+    luaL_loadstring(L,
+        "local mt, get_value, add = ...\n"
+        "local getters, methods = {value = get_value}, {add = add}\n"
+        "function mt.__index(self, k)\n"
+        "    local getter = getters[k]\n"
+        "    if getter then return getter(self) end\n"
+        "    return methods[k]\n"
+        "end");
+    apollo::push_class_metatable<counter>(L);
+    lua_pushcfunction(L, APOLLO_TO_RAW_FUNCTION(&get_counter_value));
+    lua_pushcfunction(L, APOLLO_TO_RAW_FUNCTION(&counter::add));
+    lua_call(L, 3, 0);
+}
+
+void setup_member_dispatch(lua_State* L)
+{
+    apollo::add_property<counter>(
+        L, "value", APOLLO_TO_RAW_FUNCTION(&get_counter_value));
+    apollo::add_method<counter>(
+        L, "add", APOLLO_TO_RAW_FUNCTION(&counter::add));
+}
+
+void bench_member_dispatches()
+{
+    bench_member_dispatch("Lua __index function", &setup_lua_index_glue);
+    bench_member_dispatch("add_method/add_property", &setup_member_dispatch);
+}
+
+void bench_field_access(char const* name, void (*setup)(lua_State*))
+{
+    lua_State* L = luaL_newstate();
+    apollo::register_class<counter>(L);
+    setup(L);
+    apollo::push(L, counter());
+    lua_setglobal(L, "obj");
+
+    double const read_time = bench_lua_loop(L,
+        "local obj, s = obj, 0\n"
+        "for i = 1, 1000000 do s = s + obj.value end");
+    double const write_time = bench_lua_loop(L,
+        "local obj = obj\n"
+        "for i = 1, 1000000 do obj.value = i end");
+    std::cout << "field access (" << name << "): read: "
+        << read_time << " ns, write: " << write_time << " ns\n";
+    lua_close(L);
+}
+
+void setup_member_functions(lua_State* L)
+{
+    apollo::add_property<counter>(L, "value",
+        APOLLO_TO_RAW_FUNCTION(APOLLO_MEMBER_GETTER(counter::value)),
+        APOLLO_TO_RAW_FUNCTION(APOLLO_MEMBER_SETTER(counter::value)));
+}
+
+void setup_field(lua_State* L)
+{
+    apollo::add_field<counter>(L, "value", &counter::value);
+}
+
+void bench_field_accesses()
+{
+    bench_field_access("member getter/setter", &setup_member_functions);
+    bench_field_access("add_field", &setup_field);
+}
+
+std::size_t route_by_string(std::string const& key)
+{
+    return key.size();
+}
+
+std::size_t route_by_string_ref(boost::string_ref key)
+{
+    return key.size();
+}
+
+void bench_string_arg(char const* name, lua_CFunction f)
+{
+    lua_State* L = luaL_newstate();
+    lua_pushcfunction(L, f);
+    lua_setglobal(L, "route");
+    apollo::push(L, "/api/v1/resources/" + std::string(46, 'x'));
+    lua_setglobal(L, "key");
+    double const time = bench_lua_loop(L,
+        "local route, key = route, key\n"
+        "for i = 1, 1000000 do route(key) end");
+    std::cout << "64 byte string argument (" << name << "): "
+        << time << " nanoseconds per call\n";
+    lua_close(L);
+}
+
+void bench_string_args()
+{
+    bench_string_arg("std::string const&",
+        APOLLO_TO_RAW_FUNCTION(&route_by_string));
+    bench_string_arg("boost::string_ref",
+        APOLLO_TO_RAW_FUNCTION(&route_by_string_ref));
+}
+
+// Element by element, like code without container converters does it.
+template <typename T>
+void push_naive(lua_State* L, std::vector<T> const& v)
+{
+    lua_newtable(L);
+    for (std::size_t i = 0; i < v.size(); ++i) {
+        lua_pushinteger(L, static_cast<lua_Integer>(i + 1));
+        apollo::push(L, v[i]);
+        lua_settable(L, -3);
+    }
+}
+
+template <typename T>
+std::vector<T> to_naive(lua_State* L, int idx)
+{
+    std::vector<T> v;
+    for (lua_Integer i = 1; ; ++i) {
+        lua_pushinteger(L, i);
+        lua_gettable(L, idx < 0 ? idx - 1 : idx);
+        if (lua_isnil(L, -1)) {
+            lua_pop(L, 1);
+            return v;
+        }
+        v.push_back(apollo::to<T>(L, -1));
+        lua_pop(L, 1);
+    }
+}
+
+template <typename T>
+void bench_sequence_roundtrip(char const* name)
+{
+    int const n_roundtrips = 200;
+    std::vector<T> v(10000);
+    for (std::size_t i = 0; i < v.size(); ++i)
+        v[i] = static_cast<T>(i) / 2;
+
+    lua_State* L = luaL_newstate();
+    std::size_t checksum = 0;
+    std::clock_t const best_naive = best_of_5_runs([&]() {
+        for (int i = 0; i < n_roundtrips; ++i) {
+            push_naive(L, v);
+            checksum += to_naive<T>(L, -1).size();
+            lua_pop(L, 1);
+        }
+    });
+    std::clock_t const best_apollo = best_of_5_runs([&]() {
+        for (int i = 0; i < n_roundtrips; ++i) {
+            apollo::push(L, v);
+            checksum += apollo::to<std::vector<T>>(L, -1).size();
+            lua_pop(L, 1);
+        }
+    });
+    lua_close(L);
+    if (checksum != 10 * n_roundtrips * v.size())
+        std::cout << "sequence roundtrip: wrong result!\n";
+
+    double const us = 1000000.0 / n_roundtrips;
+    std::cout << "10k element round trip (" << name << "): element-wise: "
+        << clocks_to_seconds(best_naive) * us
+        << ", converter: " << clocks_to_seconds(best_apollo) * us
+        << " microseconds\n";
+}
+
+void bench_sequence_roundtrips()
+{
+    bench_sequence_roundtrip<double>("std::vector<double>");
+    bench_sequence_roundtrip<int>("std::vector<int>");
+}
+
+using config_map = std::unordered_map<std::string, double>;
+
+void push_map_naive(lua_State* L, config_map const& m)
+{
+    lua_newtable(L);
+    for (auto const& entry: m) {
+        apollo::push(L, entry.first, entry.second);
+        lua_settable(L, -3);
+    }
+}
+
+config_map to_map_naive(lua_State* L, int idx)
+{
+    config_map m;
+    lua_pushnil(L);
+    while (lua_next(L, idx < 0 ? idx - 1 : idx)) {
+        lua_pushvalue(L, -2);
+        m.emplace(apollo::to<std::string>(L, -1), apollo::to<double>(L, -2));
+        lua_pop(L, 2);
+    }
+    return m;
+}
+
+void bench_map_roundtrip()
+{
+    int const n_roundtrips = 50;
+    config_map m;
+    for (int i = 0; i < 10000; ++i)
+        m.emplace("setting." + std::to_string(i), i / 2.0);
+
+    lua_State* L = luaL_newstate();
+    std::size_t checksum = 0;
+    std::clock_t const best_naive = best_of_5_runs([&]() {
+        for (int i = 0; i < n_roundtrips; ++i) {
+            push_map_naive(L, m);
+            checksum += to_map_naive(L, -1).size();
+            lua_pop(L, 1);
+        }
+    });
+    std::clock_t const best_apollo = best_of_5_runs([&]() {
+        for (int i = 0; i < n_roundtrips; ++i) {
+            apollo::push(L, m);
+            checksum += apollo::to<config_map>(L, -1).size();
+            lua_pop(L, 1);
+        }
+    });
+    lua_close(L);
+    if (checksum != 10 * n_roundtrips * m.size())
+        std::cout << "map roundtrip: wrong result!\n";
+
+    double const us = 1000000.0 / n_roundtrips;
+    std::cout << "10k entry round trip (std::unordered_map<std::string, "
+        "double>): entry-wise: " << clocks_to_seconds(best_naive) * us
+        << ", converter: " << clocks_to_seconds(best_apollo) * us
+        << " microseconds\n";
+}
+
+void bench_arrays()
+{
+    std::vector<float> samples(100000, 0.5f);
+    lua_State* L = luaL_newstate();
+    apollo::register_array<float>(L);
+    apollo::push(L, apollo::array_view<float>(samples.data(), samples.size()));
+    lua_setglobal(L, "a");
+    apollo::push(L, std::vector<float>(samples.size(), 0.5f));
+    lua_setglobal(L, "t");
+
+    double const ns_table = bench_lua_loop(L,
+        "local t, s = t, 0\n"
+        "for i = 1, #t do s = s + t[i] end");
+    double const ns_view = bench_lua_loop(L,
+        "local a, s = a, 0\n"
+        "for i = 1, #a do s = s + a[i] end");
+    double const ns_write = bench_lua_loop(L,
+        "local a = a\n"
+        "for i = 1, #a do a[i] = i end");
+    double const ns_sum = bench_lua_loop(L,
+        "for i = 1, 100 do a:sum() end");
+    lua_close(L);
+
+    // bench_lua_loop() divides by 1000000 loop iterations.
+    std::cout << "100k element array, per element: sum over table: "
+        << ns_table * 10 << ", sum over array_view: "
+        << ns_view * 10 << ", assign to array_view: "
+        << ns_write * 10 << ", array_view:sum(): "
+        << ns_sum / 10 << " nanoseconds\n";
+}
+
+std::vector<double> get_position_table()
+{
+    return {1.5, 2.5};
+}
+
+std::pair<double, double> get_position_pair()
+{
+    return {1.5, 2.5};
+}
+
+void bench_multiple_returns()
+{
+    lua_State* L = luaL_newstate();
+    lua_pushcfunction(L, APOLLO_TO_RAW_FUNCTION(&get_position_table));
+    lua_setglobal(L, "get_table");
+    lua_pushcfunction(L, APOLLO_TO_RAW_FUNCTION(&get_position_pair));
+    lua_setglobal(L, "get_pair");
+    double const ns_table = bench_lua_loop(L,
+        "local get = get_table\n"
+        "for i = 1, 1000000 do local t = get(); local x, y = t[1], t[2] end");
+    double const ns_pair = bench_lua_loop(L,
+        "local get = get_pair\n"
+        "for i = 1, 1000000 do local x, y = get() end");
+    lua_close(L);
+    std::cout << "return x, y: as table: " << ns_table
+        << " ns, as std::pair: " << ns_pair << " ns per call\n";
+}
+
+void bench_optional_pulls()
+{
+    int const n_pulls = 1000000;
+    lua_State* L = luaL_newstate();
+    lua_pushnil(L);
+    lua_pushinteger(L, 7);
+    double const ns_fallback = bench_callback([L](int i) {
+        return apollo::to(L, 1 + i % 2, 0);
+    }, n_pulls);
+    double const ns_optional = bench_callback([L](int i) {
+        return apollo::to<boost::optional<int>>(L, 1 + i % 2).value_or(0);
+    }, n_pulls);
+    double const ns_exception = bench_callback([L](int i) {
+        try {
+            return apollo::to<int>(L, 1 + i % 2);
+        } catch (apollo::to_cpp_conversion_error const&) {
+            return 0;
+        }
+    }, n_pulls);
+    lua_close(L);
+    std::cout << "pull int or nil: to(L, idx, fallback): " << ns_fallback
+        << " ns, boost::optional<int>: " << ns_optional
+        << " ns, catching to_cpp_conversion_error: " << ns_exception
+        << " ns\n";
+}
+
+void bench_lua_callbacks()
+{
+    lua_State* L = luaL_newstate();
+    luaL_requiref(L, "base", &luaopen_base, true);
+    lua_pop(L, 1);
+    luaL_dostring(L,
+        "function handler(msg) return msg end\n"
+        "function inc(x) return x + 1 end\n"
+        "function fail(x) error('fail', 0) end");
+    lua_getglobal(L, "handler");
+    apollo::set_error_msg_handler(L);
+
+    double ns_legacy, ns_wrapped, ns_direct, ns_try;
+    double ns_legacy_fail, ns_try_fail;
+    { // The references must be released before closing L.
+        // The std::function that apollo::to() returned before lua_callable.
+        auto const legacy_fn = [L](char const* name)
+            -> std::function<int(int)> {
+            lua_getglobal(L, name);
+            apollo::registry_reference fn(L, -1, apollo::ref_mode::move);
+            return [fn](int x) -> int {
+                lua_State* L_ = fn.L();
+                apollo::stack_balance b(L_);
+                int const oldtop = lua_gettop(L_);
+                fn.push();
+                int const n_args = apollo::detail::push_impl(L_, x);
+                apollo::pcall(L_, n_args, LUA_MULTRET);
+                return apollo::to<int>(L_, oldtop + 1);
+            };
+        };
+        auto const callable = [L](char const* name) {
+            lua_getglobal(L, name);
+            apollo::lua_callable<int(int)> f(L, -1);
+            lua_pop(L, 1);
+            return f;
+        };
+
+        int const n_calls = 1000000;
+        auto const legacy = legacy_fn("inc");
+        auto const direct = callable("inc");
+        lua_getglobal(L, "inc");
+        auto const wrapped = apollo::to<std::function<int(int)>>(L, -1);
+        lua_pop(L, 1);
+        ns_legacy = bench_callback(legacy, n_calls);
+        ns_wrapped = bench_callback(wrapped, n_calls);
+        ns_direct = bench_callback(direct, n_calls);
+        ns_try = bench_callback([&direct](int x) {
+            int r = 0;
+            direct.try_call(&r, x);
+            return r;
+        }, n_calls);
+
+        int const n_errors = 100000;
+        auto const legacy_fail = legacy_fn("fail");
+        auto const direct_fail = callable("fail");
+        ns_legacy_fail = bench_callback([&legacy_fail](int x) {
+            try {
+                return legacy_fail(x);
+            } catch (apollo::lua_api_error const&) {
+                return 0;
+            }
+        }, n_errors);
+        ns_try_fail = bench_callback([&direct_fail](int x) {
+            int r = 0;
+            return direct_fail.try_call(&r, x);
+        }, n_errors);
+    }
+    lua_close(L);
+
+    std::cout << "Lua callback: registry_reference lambda: " << ns_legacy
+        << " ns, std::function(lua_callable): " << ns_wrapped
+        << " ns, lua_callable: " << ns_direct
+        << " ns, lua_callable::try_call: " << ns_try << " ns per call\n"
+        << "failing Lua callback: lambda + catch: " << ns_legacy_fail
+        << " ns, lua_callable::try_call: " << ns_try_fail << " ns per call\n";
+}
+
+int add_one(int x)
+{
+    return x + 1;
+}
+
+void bench_function_roundtrips()
+{
+    lua_State* L = luaL_newstate();
+    double ns_lua, ns_direct;
+    { // The references must be released before closing L.
+        apollo::push(L, boost::function<int(int)>(&add_one));
+        // What apollo::to() did before unwrapping other function objects.
+        std::function<int(int)> const through_lua =
+            apollo::lua_callable<int(int)>(L, -1);
+        auto const unwrapped = apollo::to<std::function<int(int)>>(L, -1);
+        lua_pop(L, 1);
+        ns_lua = bench_callback(through_lua, 1000000);
+        ns_direct = bench_callback(unwrapped, 1000000);
+    }
+    lua_close(L);
+    std::cout << "boost::function as std::function: through Lua: " << ns_lua
+        << " ns, unwrapped: " << ns_direct << " ns per call\n";
+}
+
+int sub_one(int x)
+{
+    return x - 1;
+}
+
+void bench_function_type_checks()
+{
+    lua_State* L = luaL_newstate();
+    apollo::push(L, &add_one);
+    apollo::push(L, std::function<int(int)>(&sub_one));
+    luaL_dostring(L, "return function(x) return x end");
+    double ns[3];
+    for (int i = 0; i < 3; ++i) {
+        ns[i] = bench_callback([L, i](int) {
+            return apollo::n_conversion_steps<int(*)(int)>(L, i + 1);
+        }, 1000000);
+    }
+    lua_close(L);
+    std::cout << "n_conversion_steps<int(*)(int)>: same type: " << ns[0]
+        << " ns, other apollo function: " << ns[1]
+        << " ns, Lua function: " << ns[2] << " ns\n";
+}
+
+double scale_value(double x, double factor)
+{
+    return x * factor;
+}
+
+void bench_batched_calls()
+{
+    lua_State* L = luaL_newstate();
+    lua_pushcfunction(L, APOLLO_TO_RAW_FUNCTION(&scale_value));
+    lua_setglobal(L, "scale");
+    apollo::push(L, apollo::make_batched_function(&scale_value));
+    lua_setglobal(L, "batched_scale");
+    luaL_dostring(L,
+        "values = {}\n"
+        "for i = 1, 10000 do values[i] = i end");
+    // 100 times 10000 elements, so that the tables stay in the cache.
+    double const ns_loop = bench_lua_loop(L,
+        "local scale, values = scale, values\n"
+        "for _ = 1, 100 do\n"
+        "  local r = {}\n"
+        "  for i = 1, #values do r[i] = scale(values[i], 2) end\n"
+        "end");
+    double const ns_batched = bench_lua_loop(L,
+        "local scale, values = batched_scale, values\n"
+        "for _ = 1, 100 do local r = scale(values, 2) end");
+    lua_close(L);
+    std::cout << "scale 10k numbers: Lua loop over raw function: " << ns_loop
+        << " ns, batched function: " << ns_batched << " ns per element\n";
+}
+
+#if LUA_VERSION_NUM >= 502
+apollo::async_result<int> g_next_value;
+
+apollo::async_result<int> next_value(bool ready)
+{
+    if (ready)
+        return 1;
+    g_next_value = apollo::async_result<int>();
+    return g_next_value;
+}
+
+void bench_async_calls()
+{
+    lua_State* L = luaL_newstate();
+    apollo::push(L, apollo::make_function(&next_value));
+    lua_setglobal(L, "next_value");
+    luaL_dostring(L,
+        "function consume(ready)\n"
+        "  local sum = 0\n"
+        "  while true do sum = sum + next_value(ready) end\n"
+        "end");
+    double const ns_ready = bench_lua_loop(L,
+        "for i = 1, 1000000 do next_value(true) end");
+    lua_State* const co = lua_newthread(L);
+    lua_getglobal(co, "consume");
+    lua_pushboolean(co, false);
+    lua_resume(co, L, 1);
+    double const ns_resumed = bench_callback(
+        [](int i) { return g_next_value.resolve(i); }, 1000000);
+    g_next_value = apollo::async_result<int>(); // Release the coroutine.
+    lua_close(L);
+    std::cout << "async_result: ready: " << ns_ready
+        << " ns, yield and resume: " << ns_resumed << " ns per call\n";
+}
+#endif // LUA_VERSION_NUM >= 502
+
+// 200 classes for the state startup benchmark; many<N> derives from
+// many<N / 2>.
+template <int N>
+struct many: many<N / 2> {};
+
+template <>
+struct many<0> {};
+
+struct state_registrar {
+    lua_State* L;
+
+    template <typename T, typename... Bases>
+    void add() { apollo::register_class<T, Bases...>(L); }
+};
+
+struct shared_registrar {
+    apollo::shared_class_registry& classes;
+
+    template <typename T, typename... Bases>
+    void add() { classes.register_class<T, Bases...>(); }
+};
+
+template <typename Registrar>
+void register_many(Registrar& r, std::integral_constant<int, 0>)
+{
+    r.template add<many<0>>();
+}
+
+template <typename Registrar, int N>
+void register_many(Registrar& r, std::integral_constant<int, N>)
+{
+    register_many(r, std::integral_constant<int, N - 1>());
+    r.template add<many<N>, many<N / 2>>();
+}
+
+int const n_many_classes = 200;
+
+// Returns the resident memory of the process in bytes, or 0 if unknown.
+std::size_t resident_memory()
+{
+#ifdef __linux__
+    std::ifstream statm("/proc/self/statm");
+    std::size_t n_pages = 0, n_resident_pages = 0;
+    if (statm >> n_pages >> n_resident_pages)
+        return n_resident_pages * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+    return 0;
+}
+
+template <typename F>
+void bench_state_startup(char const* name, F setup_state)
+{
+    int const num_states = 1000;
+    std::vector<lua_State*> states;
+    states.reserve(num_states);
+    std::size_t const memory_before = resident_memory();
+    std::clock_t const start = std::clock();
+    for (int i = 0; i < num_states; ++i) {
+        lua_State* L = luaL_newstate();
+        setup_state(L);
+        apollo::push(L, many<0>());
+        lua_pop(L, 1);
+        states.push_back(L);
+    }
+    std::clock_t const end = std::clock();
+    std::size_t const memory_after = resident_memory();
+    for (lua_State* L: states)
+        lua_close(L);
+    std::cout << "state startup (" << name << ", " << n_many_classes
+        << " classes): "
+        << clocks_to_seconds(end - start) * 1000000 / num_states
+        << " microseconds, "
+        << static_cast<double>(memory_after - memory_before) / 1024 / num_states
+        << " KiB resident memory per state\n";
+}
+
+void bench_state_startups()
+{
+    // Freed memory is usually not returned to the system but reused, so the
+    // variant that needs less memory is run first.
+    using last_class = std::integral_constant<int, n_many_classes - 1>;
+    apollo::shared_class_registry classes;
+    shared_registrar r = {classes};
+    register_many(r, last_class());
+    classes.freeze();
+    bench_state_startup("shared_class_registry", [&classes](lua_State* L) {
+        classes.attach(L);
+    });
+
+    bench_state_startup("register_class", [](lua_State* L) {
+        state_registrar r_ = {L};
+        register_many(r_, last_class());
+    });
+}
+
 } // anonymous namespace
 
 
 int main()
 {
+    bench_state_startups(); // First, so that no freed memory is reused.
+
     const int num_calls = 100000;
     const int loops = 10;
 
@@ -95,10 +1098,40 @@ int main()
     double time2 = clocks_to_seconds(total2);
     double time3 = clocks_to_seconds(total3);
 
+    int const num_pushes = 1000000;
+    std::clock_t total_push = 0;
+    for (int i = 0; i < loops; ++i)
+        total_push += bench_push(L, num_pushes);
+    double time_push = clocks_to_seconds(total_push);
+
     std::cout
         << "apollo : " << time1 * 1000000 / num_calls / loops << " microseconds per call\n"
         << "empty  : " << time2 * 1000000 / num_calls / loops << " microseconds per call\n"
-        << "apollo w/o raw: " << time3 * 1000000 / num_calls / loops << " microseconds per call\n";
+        << "apollo w/o raw: " << time3 * 1000000 / num_calls / loops << " microseconds per call\n"
+        << "push A*: " << time_push * 1000000000 / num_pushes / loops << " nanoseconds per push\n";
+
+    bench_casts(L);
+    bench_instance_checks(L);
+    bench_gc_allocs();
+    bench_identity_cache(false);
+    bench_identity_cache(true);
+    bench_memory_pool();
+    bench_memfn_calls();
+    bench_member_dispatches();
+    bench_field_accesses();
+    bench_string_args();
+    bench_sequence_roundtrips();
+    bench_map_roundtrip();
+    bench_arrays();
+    bench_multiple_returns();
+    bench_optional_pulls();
+    bench_lua_callbacks();
+    bench_function_roundtrips();
+    bench_function_type_checks();
+    bench_batched_calls();
+#if LUA_VERSION_NUM >= 502
+    bench_async_calls();
+#endif
 
     lua_close(L);
 }
@@ -0,0 +1,136 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+// Measures calls of overloaded functions, including the number of heap
+// allocations done by C++ code per call (Lua's own allocations go through its
+// lua_Alloc and are not counted).
+
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <new>
+
+#include <apollo/builtin_types.hpp>
+#include <apollo/class.hpp>
+#include <apollo/create_table.hpp>
+#include <apollo/emplace_ctor.hpp>
+#include <apollo/function.hpp>
+#include <apollo/overload.hpp>
+#include <apollo/static_overload.hpp>
+
+namespace {
+
+unsigned long g_n_allocs = 0;
+
+} // anonymous namespace
+
+void* operator new(std::size_t size)
+{
+    ++g_n_allocs;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) BOOST_NOEXCEPT
+{
+    std::free(p);
+}
+
+namespace {
+
+struct vec2 {
+    vec2(float x_, float y_): x(x_), y(y_) {}
+    float x, y;
+};
+
+vec2 g_position(0, 0);
+
+void set_position_xy(float x, float y)
+{
+    g_position.x = x;
+    g_position.y = y;
+}
+
+void set_position_vec(vec2 const& pos)
+{
+    g_position = pos;
+}
+
+void set_position_str(char const*)
+{
+}
+
+inline double clocks_to_seconds(std::clock_t c)
+{
+    return static_cast<double>(c) / CLOCKS_PER_SEC;
+}
+
+void bench(lua_State* L, char const* name, char const* code, int num_calls)
+{
+    if (luaL_loadstring(L, code) != LUA_OK) {
+        std::cerr << lua_tostring(L, -1) << '\n';
+        lua_pop(L, 1);
+        return;
+    }
+    unsigned long const n_allocs_before = g_n_allocs;
+    std::clock_t start = std::clock();
+    if (lua_pcall(L, 0, 0, 0) != LUA_OK) {
+        std::cerr << lua_tostring(L, -1) << '\n';
+        lua_pop(L, 1);
+        return;
+    }
+    std::clock_t end = std::clock();
+    std::cout << name << ": "
+        << clocks_to_seconds(end - start) * 1000000000 / num_calls
+        << " nanoseconds, "
+        << static_cast<double>(g_n_allocs - n_allocs_before) / num_calls
+        << " heap allocations per call\n";
+}
+
+} // anonymous namespace
+
+
+int main()
+{
+    lua_State* L = luaL_newstate();
+
+    apollo::register_class<vec2>(L);
+    lua_pushglobaltable(L);
+    apollo::rawset_table(L, -1)
+        ("vec2", apollo::get_raw_emplace_ctor_wrapper<vec2, float, float>())
+        ("set_position", apollo::make_overloadset(
+            &set_position_xy, &set_position_vec, &set_position_str))
+        ("set_position_static", apollo::make_static_overloadset<
+            APOLLO_STATIC_OVERLOAD(&set_position_xy),
+            APOLLO_STATIC_OVERLOAD(&set_position_vec),
+            APOLLO_STATIC_OVERLOAD(&set_position_str)>())
+        ("set_position_xy", &set_position_xy)
+        ("set_position_xy_static", APOLLO_TO_RAW_FUNCTION(&set_position_xy));
+    lua_pop(L, 1);
+
+    int const num_calls = 1000000;
+    bench(L, "set_position(x, y)",
+        "for i = 1, 1000000 do set_position(i, 2) end", num_calls);
+    bench(L, "set_position(vec2)",
+        "local v = vec2(1, 2)\n"
+        "for i = 1, 1000000 do set_position(v) end", num_calls);
+    bench(L, "set_position_xy(x, y) (not overloaded)",
+        "for i = 1, 1000000 do set_position_xy(i, 2) end", num_calls);
+    bench(L, "set_position_static(x, y)",
+        "for i = 1, 1000000 do set_position_static(i, 2) end", num_calls);
+    bench(L, "set_position_static(vec2)",
+        "local v = vec2(1, 2)\n"
+        "for i = 1, 1000000 do set_position_static(v) end", num_calls);
+    bench(L, "set_position_xy_static(x, y) (not overloaded)",
+        "for i = 1, 1000000 do set_position_xy_static(i, 2) end", num_calls);
+
+    lua_getglobal(L, "set_position");
+    auto const stats = apollo::get_overload_cache_stats(L, -1);
+    lua_pop(L, 1);
+    std::cout << "set_position resolution cache: "
+        << stats.n_hits << " hits, " << stats.n_misses << " misses\n";
+
+    lua_close(L);
+}
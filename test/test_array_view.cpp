@@ -0,0 +1,152 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include <apollo/array_view.hpp>
+#include <apollo/builtin_types.hpp>
+
+#include <climits>
+
+#include "test_prefix.hpp"
+
+namespace {
+
+struct array_fixture_init {
+    explicit array_fixture_init(lua_State* L)
+    {
+        luaL_requiref(L, "base", &luaopen_base, true);
+        lua_pop(L, 1);
+        apollo::register_array<float>(L);
+        apollo::register_array<int>(L);
+        apollo::register_array<unsigned>(L);
+        apollo::register_array<long long>(L);
+    }
+};
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(array_view_access)
+{
+    array_fixture_init init(L);
+    std::vector<float> positions = {1.f, 2.f, 3.f};
+    apollo::push(L, apollo::array_view<float>(
+        positions.data(), positions.size()));
+    lua_setglobal(L, "a");
+
+    require_dostring(L,
+        "assert(#a == 3)\n"
+        "assert(a[1] == 1 and a[3] == 3)\n"
+        "a[2] = 20\n"
+        "a[3.0] = 30\n"
+        "assert(a.nonexisting == nil)");
+    BOOST_CHECK_EQUAL(positions[1], 20.f);
+    BOOST_CHECK_EQUAL(positions[2], 30.f);
+
+    require_dostring(L,
+        "for _, i in ipairs{0, 4, -1, 1.5, 0/0, 1e300, -1e300} do\n"
+        "  assert(not pcall(function() return a[i] end))\n"
+        "  assert(not pcall(function() a[i] = 1 end))\n"
+        "end\n"
+        "assert(not pcall(function() return a[true] end))\n"
+        "assert(a['2'] == nil, 'strings are member names')\n"
+        "assert(not pcall(function() a['2'] = 1 end))\n"
+        "assert(not pcall(function() a[1] = 'x' end))\n"
+        "assert(not pcall(function() a.x = 1 end))");
+    BOOST_CHECK_EQUAL(positions[0], 1.f);
+
+    // Views of const arrays are read-only.
+    apollo::array_view<float> const view(positions.data(), positions.size());
+    apollo::push(L, &view);
+    lua_setglobal(L, "c");
+    require_dostring(L,
+        "assert(c[2] == 20 and #c == 3 and c:sum() == 51)\n"
+        "assert(not pcall(function() c[1] = 2 end))\n"
+        "assert(not pcall(function() c:fill(2) end))");
+    BOOST_CHECK_EQUAL(positions[0], 1.f);
+}
+
+BOOST_AUTO_TEST_CASE(owned_array_bulk)
+{
+    array_fixture_init init(L);
+    apollo::owned_array<int> ints(4, 3);
+    apollo::push(L, ints);
+    lua_setglobal(L, "i");
+    apollo::push(L, apollo::owned_array<float>(std::vector<float>{
+        1.5f, -2.f, 4.f, 0.f, 8.f}));
+    lua_setglobal(L, "f");
+    apollo::push(L, apollo::owned_array<float>(5));
+    lua_setglobal(L, "g");
+    apollo::push(L, apollo::owned_array<int>());
+    lua_setglobal(L, "empty");
+
+    require_dostring(L,
+        "assert(#i == 4 and i:sum() == 12)\n"
+        "i[2] = 10; i[4] = -1\n"
+        "assert(i:min() == -1 and i:max() == 10 and i:sum() == 15)\n"
+        "i:scale(2)\n"
+        "assert(i[1] == 6 and i[2] == 20)\n"
+        "i:scale(0.5)\n"
+        "assert(i[1] == 3 and i[2] == 10 and i[4] == -1)\n"
+        "assert(not pcall(i.scale, i, 'x'))\n"
+        "assert(f:sum() == 11.5 and f:min() == -2 and f:max() == 8)\n"
+        "g:fill(1)\n"
+        "g:axpy(2, f)\n"
+        "assert(g[1] == 4 and g[2] == -3 and g[5] == 17)\n"
+        "g:copy(f)\n"
+        "assert(g[1] == 1.5 and g:sum() == f:sum())\n"
+        "assert(not pcall(g.copy, g, i))\n"
+        "assert(not pcall(i.axpy, i, 1, empty))\n"
+        "assert(#empty == 0 and empty:sum() == 0)\n"
+        "assert(empty:min() == nil and empty:max() == nil)");
+    BOOST_CHECK_EQUAL(ints[1], 3); // The pushed copy was modified.
+}
+
+BOOST_AUTO_TEST_CASE(array_sum_range)
+{
+    array_fixture_init init(L);
+    unsigned const big = 0xfffffff0u;
+    apollo::push(L, apollo::owned_array<unsigned>(3, big));
+    lua_setglobal(L, "u");
+    apollo::push(L, apollo::owned_array<long long>(
+        std::vector<long long>{LLONG_MAX, LLONG_MAX}));
+    lua_setglobal(L, "ll");
+    require_dostring(L, "usum = u:sum(); llsum = ll:sum()");
+
+    // Sums of narrower integers are exact, wider ones do not overflow.
+    lua_getglobal(L, "usum");
+    BOOST_CHECK_EQUAL(apollo::to<unsigned long long>(L, -1), 3ull * big);
+    lua_getglobal(L, "llsum");
+    BOOST_CHECK_EQUAL(
+        lua_tonumber(L, -1), 2 * static_cast<double>(LLONG_MAX));
+    lua_pop(L, 2);
+}
+
+BOOST_AUTO_TEST_CASE(array_kernels)
+{
+    std::vector<double> v(1003);
+    for (std::size_t i = 0; i < v.size(); ++i)
+        v[i] = static_cast<double>(i % 17) - 8;
+    v[501] = 100;
+    v[1002] = -100;
+    double expected_sum = 0;
+    for (double d: v)
+        expected_sum += d;
+    BOOST_CHECK_EQUAL(
+        apollo::detail::array_sum<double>(v.data(), v.size()), expected_sum);
+    BOOST_CHECK_EQUAL(
+        apollo::detail::array_extremum<true>(v.data(), v.size()), 100);
+    BOOST_CHECK_EQUAL(
+        apollo::detail::array_extremum<false>(v.data(), v.size()), -100);
+    BOOST_CHECK_EQUAL(apollo::detail::array_extremum<false>(v.data(), 2), -8);
+
+    apollo::owned_array<double> a(v);
+    apollo::owned_array<double> b(a);
+    BOOST_CHECK(b.data() != a.data());
+    BOOST_CHECK(b.storage() == v);
+    apollo::owned_array<double> c(std::move(b));
+    BOOST_CHECK(c.storage() == v);
+    BOOST_CHECK_EQUAL(c.data(), c.storage().data());
+    BOOST_CHECK(b.empty());
+}
+
+#include "test_suffix.hpp"
@@ -0,0 +1,239 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include <apollo/async_result.hpp>
+#include <apollo/builtin_types.hpp>
+#include <apollo/function.hpp>
+#include <apollo/stack_balance.hpp>
+
+#include <functional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "test_prefix.hpp"
+
+namespace {
+
+// Answers lookups of key with key * 10 once run() is called, in a random
+// order. Key 0 is answered at once, negative keys are rejected.
+class fake_service {
+public:
+    apollo::async_result<int> lookup(int key)
+    {
+        if (key == 0)
+            return 0;
+        apollo::async_result<int> result;
+        m_requests.push_back(std::make_pair(key, result));
+        return result;
+    }
+
+    std::size_t n_pending() const { return m_requests.size(); }
+
+    // Completes requests, including those made by the resumed coroutines,
+    // until there are none left. Returns the number of coroutines that
+    // finished; errors are counted in n_errors.
+    unsigned run()
+    {
+        unsigned n_finished = 0;
+        while (!m_requests.empty()) {
+            std::size_t const i = m_rng() % m_requests.size();
+            std::swap(m_requests[i], m_requests.back());
+            auto request = std::move(m_requests.back());
+            m_requests.pop_back();
+
+            int const key = request.first;
+            BOOST_REQUIRE(request.second.suspended());
+            int const status = key < 0 ?
+                request.second.reject("no such key: " + std::to_string(key)) :
+                request.second.resolve(key * 10);
+            BOOST_CHECK(request.second.ready());
+            if (status == LUA_OK)
+                ++n_finished;
+            else if (status != LUA_YIELD)
+                ++n_errors;
+        }
+        return n_finished;
+    }
+
+    unsigned n_errors = 0;
+
+private:
+    std::vector<std::pair<int, apollo::async_result<int>>> m_requests;
+    std::minstd_rand m_rng;
+};
+
+apollo::async_result<int> resolved()
+{
+    apollo::async_result<int> result;
+    BOOST_CHECK(!result.ready());
+    BOOST_CHECK_EQUAL(result.resolve(7), LUA_OK);
+    BOOST_CHECK(result.ready());
+    BOOST_CHECK(!result.suspended());
+    return result;
+}
+
+apollo::async_result<std::string> rejected()
+{
+    apollo::async_result<std::string> result;
+    BOOST_CHECK_EQUAL(result.reject("sorry"), LUA_OK);
+    return result;
+}
+
+apollo::async_result<void> done()
+{
+    return apollo::async_result<void>::ready_result();
+}
+
+apollo::async_result<void> g_wakeup;
+
+apollo::async_result<void> sleep()
+{
+    g_wakeup = apollo::async_result<void>();
+    return g_wakeup;
+}
+
+void push_lookup(lua_State* L, fake_service& service)
+{
+    apollo::push(L, std::function<apollo::async_result<int>(int)>(
+        [&service](int key) { return service.lookup(key); }));
+    lua_setglobal(L, "lookup");
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(async_result_ready)
+{
+    luaL_requiref(L, "base", &luaopen_base, true);
+    lua_pop(L, 1);
+    apollo::stack_balance balance(L);
+
+    apollo::push(L, apollo::make_function(&resolved));
+    lua_setglobal(L, "resolved");
+    apollo::push(L, apollo::make_function(&rejected));
+    lua_setglobal(L, "rejected");
+    apollo::push(L, apollo::make_function(&done));
+    lua_setglobal(L, "done");
+
+    // Results that are ready on return do not yield, not even on the main
+    // thread.
+    fake_service service;
+    push_lookup(L, service);
+    require_dostring(L,
+        "assert(lookup(0) == 0)\n"
+        "assert(resolved() == 7)\n"
+        "assert(select('#', done()) == 0)\n"
+        "local ok, msg = pcall(rejected)\n"
+        "assert(not ok and msg == 'sorry')");
+    BOOST_CHECK_EQUAL(service.n_pending(), 0u);
+
+    // Pending results cannot be waited for on the main thread.
+    require_dostring(L,
+        "local ok, msg = pcall(lookup, 1)\n"
+        "assert(not ok and msg == 'attempt to yield from outside a coroutine')");
+    BOOST_CHECK_EQUAL(service.n_pending(), 1u); // But never suspended.
+}
+
+BOOST_AUTO_TEST_CASE(async_result_lua_coroutine)
+{
+    luaL_requiref(L, "base", &luaopen_base, true);
+    luaL_requiref(L, "coroutine", &luaopen_coroutine, true);
+    lua_pop(L, 2);
+    apollo::stack_balance balance(L);
+    apollo::push(L, apollo::make_function(&sleep));
+    lua_setglobal(L, "sleep");
+
+    require_dostring(L,
+        "co = coroutine.create(function(x)\n"
+        "    local n = select('#', sleep())\n"
+        "    return x, n\n"
+        "end)\n"
+        "assert(coroutine.resume(co, 'woken') == true)\n"
+        "assert(coroutine.status(co) == 'suspended')");
+    lua_getglobal(L, "co");
+    lua_State* const co = lua_tothread(L, -1);
+    BOOST_REQUIRE(co);
+    BOOST_REQUIRE(g_wakeup.suspended());
+    BOOST_CHECK_EQUAL(g_wakeup.thread(), co);
+
+    // Resuming from C++ continues the coroutine in the call to sleep().
+    BOOST_CHECK_EQUAL(g_wakeup.resolve(), LUA_OK);
+    BOOST_CHECK(g_wakeup.ready());
+    BOOST_CHECK(!g_wakeup.suspended());
+    BOOST_REQUIRE_EQUAL(lua_gettop(co), 2);
+    BOOST_CHECK_EQUAL(lua_tostring(co, 1), std::string("woken"));
+    BOOST_CHECK_EQUAL(lua_tointeger(co, 2), 0);
+    lua_pop(L, 1);
+}
+
+BOOST_AUTO_TEST_CASE(async_result_coroutines)
+{
+    luaL_requiref(L, "base", &luaopen_base, true);
+    luaL_requiref(L, "string", &luaopen_string, true);
+    lua_pop(L, 2);
+    apollo::stack_balance balance(L);
+    fake_service service;
+    push_lookup(L, service);
+    require_dostring(L,
+        "results = {}\n"
+        "function worker(id)\n"
+        "    local sum = lookup(id) + lookup(0)\n"
+        "    local ok, msg = pcall(lookup, -id)\n"
+        "    assert(not ok and msg == 'no such key: ' .. -id, msg)\n"
+        "    sum = sum + lookup(id + 1)\n"
+        "    results[id] = sum\n"
+        "    return sum\n"
+        "end");
+
+    int const n_coroutines = 5000;
+    for (int id = 1; id <= n_coroutines; ++id) {
+        lua_State* const co = lua_newthread(L);
+        lua_getglobal(co, "worker");
+        lua_pushinteger(co, id);
+        BOOST_REQUIRE_EQUAL(lua_resume(co, L, 1), LUA_YIELD);
+        BOOST_REQUIRE_EQUAL(lua_gettop(co), 0);
+        lua_pop(L, 1); // Only the pending result references the thread now.
+    }
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    BOOST_REQUIRE_EQUAL(service.n_pending(),
+        static_cast<std::size_t>(n_coroutines));
+
+    BOOST_CHECK_EQUAL(service.run(), static_cast<unsigned>(n_coroutines));
+    BOOST_CHECK_EQUAL(service.n_errors, 0u);
+
+    lua_getglobal(L, "results");
+    for (int id = 1; id <= n_coroutines; ++id) {
+        lua_rawgeti(L, -1, id);
+        BOOST_CHECK_EQUAL(lua_tointeger(L, -1), id * 10 + (id + 1) * 10);
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+}
+
+BOOST_AUTO_TEST_CASE(async_result_errors)
+{
+    luaL_requiref(L, "base", &luaopen_base, true);
+    lua_pop(L, 1);
+    apollo::stack_balance balance(L);
+    fake_service service;
+    push_lookup(L, service);
+    require_dostring(L,
+        "function worker(key)\n"
+        "    return lookup(key)\n"
+        "end");
+
+    // An unhandled rejection ends the coroutine with the error.
+    lua_State* const co = lua_newthread(L);
+    lua_getglobal(co, "worker");
+    lua_pushinteger(co, -3);
+    BOOST_REQUIRE_EQUAL(lua_resume(co, L, 1), LUA_YIELD);
+    BOOST_CHECK_EQUAL(service.run(), 0u);
+    BOOST_CHECK_EQUAL(service.n_errors, 1u);
+    BOOST_CHECK_EQUAL(lua_status(co), LUA_ERRRUN);
+    BOOST_CHECK_EQUAL(lua_tostring(co, -1), std::string("no such key: -3"));
+    lua_pop(L, 1);
+}
+
+#include "test_suffix.hpp"
@@ -0,0 +1,99 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include <apollo/batched_function.hpp>
+#include <apollo/builtin_types.hpp>
+#include <apollo/class.hpp>
+#include <apollo/function.hpp>
+
+#include "test_prefix.hpp"
+
+namespace {
+
+unsigned g_n_calls = 0;
+
+double scale(double x, double factor)
+{
+    return x * factor;
+}
+
+void count(int n)
+{
+    g_n_calls += static_cast<unsigned>(n);
+}
+
+struct counter {
+    int n;
+    int add(int d) { return n += d; }
+};
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(batched_free_function)
+{
+    luaL_requiref(L, "base", &luaopen_base, true);
+    luaL_requiref(L, "string", &luaopen_string, true);
+    lua_pop(L, 2);
+    apollo::push(L, apollo::make_batched_function(&scale));
+    lua_setglobal(L, "scale");
+    apollo::push(L, apollo::make_batched_function(&count));
+    lua_setglobal(L, "count");
+    apollo::push(L, apollo::make_batched_function(
+        std::function<std::string(std::string const&, int)>(
+            [](std::string const& s, int n) {
+                std::string r;
+                for (int i = 0; i < n; ++i)
+                    r += s;
+                return r;
+            })));
+    lua_setglobal(L, "rep");
+
+    require_dostring(L,
+        "local r = scale({1, 2, 3}, 2)\n"
+        "assert(#r == 3 and r[1] == 2 and r[2] == 4 and r[3] == 6)\n"
+        "r = scale({1, 2}, {3, 4})\n"
+        "assert(#r == 2 and r[1] == 3 and r[2] == 8)\n"
+        "r = scale(3, 4)\n" // Only scalars: one call.
+        "assert(#r == 1 and r[1] == 12)\n"
+        "r = scale({}, 2)\n"
+        "assert(next(r) == nil)\n"
+        "assert(select('#', count({1, 2, 3})) == 0)\n"
+        "r = rep({'a', 'b'}, {2, 3})\n"
+        "assert(r[1] == 'aa' and r[2] == 'bbb')");
+    BOOST_CHECK_EQUAL(g_n_calls, 6u);
+
+    require_dostring(L,
+        "local ok, msg = pcall(scale, {1, 2}, {3})\n"
+        "assert(not ok and msg:find('differ in length'), msg)\n"
+        "ok, msg = pcall(scale, {1, 'x', 3}, 2)\n"
+        "assert(not ok and msg:find('batch element 2'), msg)\n"
+        "assert(msg:find('#1'), msg)\n"
+        "ok, msg = pcall(scale, {1, 2}, {})\n"
+        "assert(not ok)\n"
+        "assert(not pcall(scale, {1, 2}))");
+}
+
+BOOST_AUTO_TEST_CASE(batched_member_function)
+{
+    luaL_requiref(L, "base", &luaopen_base, true);
+    lua_pop(L, 1);
+    apollo::register_class<counter>(L);
+    apollo::push(L, apollo::make_batched_function(&counter::add));
+    lua_setglobal(L, "add");
+    counter a{0}, b{10};
+    apollo::push(L, &a);
+    lua_setglobal(L, "a");
+    apollo::push(L, &b);
+    lua_setglobal(L, "b");
+
+    require_dostring(L,
+        "local r = add({a, b, a}, {1, 2, 3})\n"
+        "assert(r[1] == 1 and r[2] == 12 and r[3] == 4)\n"
+        "r = add(b, {1, 1})\n"
+        "assert(r[1] == 13 and r[2] == 14)");
+    BOOST_CHECK_EQUAL(a.n, 4);
+    BOOST_CHECK_EQUAL(b.n, 14);
+}
+
+#include "test_suffix.hpp"
@@ -0,0 +1,110 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include <apollo/builtin_types.hpp>
+#include <apollo/class.hpp>
+#include <apollo/closing_lstate.hpp>
+#include <apollo/detail/integer_seq.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "test_prefix.hpp"
+
+namespace {
+
+// Only used through allocate_class_id(), so that their IDs are allocated by
+// the threads of the stress test (and not during static initialization).
+template <int N>
+struct stress_tag {};
+
+int const n_stress_types = 300;
+int const n_threads = 16;
+
+using type_info_vec = std::vector<boost::typeindex::type_info const*>;
+
+template <int... Is>
+type_info_vec stress_types(apollo::detail::iseq<Is...>)
+{
+    return {&boost::typeindex::type_id<stress_tag<Is>>().type_info()...};
+}
+
+struct plugin_base {
+    virtual ~plugin_base() {}
+};
+
+template <int N>
+struct plugin_cls: plugin_base {
+    int n = N;
+};
+
+// Simulates loading a plugin module: registers its classes in a new state
+// and uses them. Returns false on failure (Boost.Test's assertions must not be
+// used from multiple threads).
+template <int N>
+bool load_plugin()
+{
+    apollo::closing_lstate L;
+    apollo::register_class<plugin_base>(L);
+    apollo::register_class<plugin_cls<N>, plugin_base>(L);
+    plugin_cls<N> obj;
+    apollo::push(L, &obj);
+    return apollo::to<plugin_base*>(L, -1) == &obj
+        && apollo::to<plugin_cls<N>&>(L, -1).n == N;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(concurrent_class_id_allocation)
+{
+    type_info_vec const types = stress_types(
+        apollo::detail::iseq_n_t<n_stress_types>());
+    std::vector<std::vector<std::size_t>> ids(
+        n_threads, std::vector<std::size_t>(types.size()));
+    std::atomic<int> n_waiting(n_threads);
+    std::atomic<int> n_failed_plugins(0);
+
+    auto const run = [&types, &ids, &n_waiting, &n_failed_plugins](int t) {
+        --n_waiting;
+        while (n_waiting > 0) // Start all threads at once.
+            std::this_thread::yield();
+
+        // Different starting points, so that threads both allocate new IDs
+        // and look up ones allocated by others.
+        auto& thread_ids = ids[static_cast<std::size_t>(t)];
+        auto const offset = static_cast<std::size_t>(t) * 7;
+        for (std::size_t i = 0; i < types.size(); ++i) {
+            auto const j = (i + offset) % types.size();
+            thread_ids[j] = apollo::detail::allocate_class_id(*types[j]);
+        }
+        if (!load_plugin<1>() || !load_plugin<2>())
+            ++n_failed_plugins;
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < n_threads; ++t)
+        threads.emplace_back(run, t);
+    for (auto& thread: threads)
+        thread.join();
+
+    BOOST_CHECK_EQUAL(n_failed_plugins, 0);
+    for (int t = 1; t < n_threads; ++t)
+        BOOST_CHECK(ids[static_cast<std::size_t>(t)] == ids.front());
+    std::set<std::size_t> const unique_ids(
+        ids.front().begin(), ids.front().end());
+    BOOST_CHECK_EQUAL(unique_ids.size(), types.size());
+
+    // IDs allocated during static initialization are found, too.
+    BOOST_CHECK_EQUAL(
+        apollo::detail::allocate_class_id(
+            boost::typeindex::type_id<plugin_base>().type_info()),
+        apollo::detail::static_class_id<plugin_base>::id);
+    BOOST_CHECK(unique_ids.find(apollo::detail::static_class_id<
+        plugin_base>::id) == unique_ids.end());
+}
+
+#include "test_suffix.hpp"
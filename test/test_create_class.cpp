@@ -3,6 +3,7 @@
 // See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
 
 #include <apollo/create_class.hpp>
+#include <apollo/property.hpp>
 
 #include "test_prefix.hpp"
 
@@ -27,6 +28,55 @@ public:
     }
 };
 
+struct point {
+    int x;
+    int y;
+    int sum() const { return x + y; }
+};
+
+struct point3: point {
+    int z;
+    int sum3() const { return sum() + z; }
+};
+
+struct tag_base {
+    char const* tag = "tag";
+};
+
+struct entity: tag_base {
+    unsigned char flags = 1;
+    bool alive = true;
+    short hp = -5;
+    unsigned long long uid = 1234567;
+    float speed = 1.5f;
+    double mass = 2.25;
+    int const kind = 3;
+};
+
+struct player: point, entity {
+    long score = 0;
+};
+
+// extent is a non-primary base of the polymorphic box.
+struct shape {
+    virtual ~shape() {}
+    int id = 1;
+};
+
+struct extent {
+    double width = 2.5;
+    int height = 3;
+};
+
+struct box: shape, extent {
+    int depth = 4;
+};
+
+int get_id(point const&)
+{
+    return 42;
+}
+
 } // anonymous namespace
 
 BOOST_AUTO_TEST_CASE(simple)
@@ -87,4 +137,196 @@ BOOST_AUTO_TEST_CASE(nested)
     BOOST_CHECK_EQUAL(g_n_calls, 2u);
 }
 
+BOOST_AUTO_TEST_CASE(member_dispatch)
+{
+    luaL_requiref(L, "base", &luaopen_base, true);
+    lua_pop(L, 1);
+
+    lua_pushglobaltable(L);
+    apollo::export_classes(L, -1)
+        .cls<point>("point")
+            .ctor<>()
+            .method("sum", APOLLO_TO_RAW_FUNCTION(&point::sum))
+            .property("x",
+                APOLLO_TO_RAW_FUNCTION(APOLLO_MEMBER_GETTER(point::x)),
+                APOLLO_TO_RAW_FUNCTION(APOLLO_MEMBER_SETTER(point::x)))
+            .property("y",
+                APOLLO_TO_RAW_FUNCTION(APOLLO_MEMBER_GETTER(point::y)),
+                APOLLO_TO_RAW_FUNCTION(APOLLO_MEMBER_SETTER(point::y)))
+            .property("id", APOLLO_TO_RAW_FUNCTION(&get_id))
+        .end_cls()
+        .cls<point3, point>("point3")
+            .ctor<>()
+            .method("sum3", APOLLO_TO_RAW_FUNCTION(&point3::sum3))
+            .property("z",
+                APOLLO_TO_RAW_FUNCTION(APOLLO_MEMBER_GETTER(point3::z)),
+                APOLLO_TO_RAW_FUNCTION(APOLLO_MEMBER_SETTER(point3::z)))
+        .end_cls();
+    lua_pop(L, 1);
+
+    require_dostring(L,
+        "local p = point.new()\n"
+        "p.x, p.y = 1, 2\n"
+        "assert(p.x == 1 and p.y == 2)\n"
+        "assert(p:sum() == 3)\n"
+        "assert(p.id == 42)\n"
+        "assert(p.nonexistent == nil)\n"
+        "assert(not pcall(function() p.id = 1 end), 'read-only')\n"
+        "assert(not pcall(function() p.sum = 1 end), 'method')\n"
+        "assert(not pcall(function() p.nonexistent = 1 end), 'unknown')\n"
+        "local p3 = point3.new()\n"
+        "p3.x, p3.y, p3.z = 1, 2, 3\n"
+        "assert(p3:sum() == 3, 'inherited method')\n"
+        "assert(p3:sum3() == 6)\n"
+        "assert(p3.id == 42, 'inherited property')\n"
+        "assert(p.z == nil and p.sum3 == nil, 'derived member in base')\n");
+
+    // Pointers and const pointers share the class's members.
+    point3 obj;
+    obj.x = 5;
+    obj.y = 6;
+    obj.z = 7;
+    apollo::push(L, &obj);
+    lua_setglobal(L, "obj");
+    apollo::push(L, static_cast<point const*>(&obj));
+    lua_setglobal(L, "cobj");
+    require_dostring(L,
+        "assert(obj:sum3() == 18)\n"
+        "obj.x = 10\n"
+        "assert(cobj.x == 10 and cobj:sum() == 16)\n"
+        "assert(not pcall(function() cobj.x = 1 end), 'const')\n");
+    BOOST_CHECK_EQUAL(obj.x, 10);
+
+    // Members added after the metatable was created, also to derived classes
+    // (unless they override them).
+    apollo::add_method<point>(L, "get_id", APOLLO_TO_RAW_FUNCTION(&get_id));
+    apollo::add_method<point3>(L, "sum", APOLLO_TO_RAW_FUNCTION(&point3::sum3));
+    apollo::add_method<point>(L, "sum3", APOLLO_TO_RAW_FUNCTION(&point::sum));
+    require_dostring(L,
+        "assert(point.new():get_id() == 42)\n"
+        "assert(obj:get_id() == 42, 'inherited late')\n"
+        "assert(obj:sum() == 23 and cobj:sum() == 16, 'overridden')\n"
+        "assert(obj:sum3() == 23, 'own member precedes late base member')\n");
+}
+
+BOOST_AUTO_TEST_CASE(late_base_members)
+{
+    luaL_requiref(L, "base", &luaopen_base, true);
+    lua_pop(L, 1);
+
+    lua_pushglobaltable(L);
+    apollo::export_classes(L, -1)
+        .cls<point>("point")
+            .ctor<>()
+        .end_cls()
+        .cls<point3, point>("point3")
+            .ctor<>()
+        .end_cls();
+    lua_pop(L, 1);
+
+    // The metatables exist before any class has members.
+    require_dostring(L, "p3 = point3.new()");
+    apollo::add_field<point>(L, "x", &point::x);
+    apollo::add_field<point3>(L, "z", &point3::z);
+    apollo::add_field<point>(L, "y", &point::y);
+    require_dostring(L,
+        "p3.x, p3.y, p3.z = 1, 2, 3\n"
+        "assert(p3.x + p3.y + p3.z == 6)\n"
+        "assert(point.new().z == nil)\n");
+}
+
+BOOST_AUTO_TEST_CASE(fields)
+{
+    luaL_requiref(L, "base", &luaopen_base, true);
+    lua_pop(L, 1);
+
+    lua_pushglobaltable(L);
+    apollo::export_classes(L, -1)
+        .cls<point>("point")
+            .field("x", &point::x)
+            .field("y", &point::y, true)
+        .end_cls()
+        .cls<entity>("entity")
+            .field("flags", &entity::flags)
+            .field("alive", &entity::alive)
+            .field("hp", &entity::hp)
+            .field("uid", &entity::uid)
+            .field("speed", &entity::speed)
+            .field("mass", &entity::mass)
+            .field("kind", &entity::kind)
+        .end_cls()
+        .cls<player, point, entity>("player")
+            .ctor<>()
+            .field("score", &player::score)
+            .field("flags2", &player::flags) // Inherited from entity.
+        .end_cls();
+    lua_pop(L, 1);
+
+    require_dostring(L,
+        "local p = player.new()\n"
+        "assert(p.flags == 1 and p.flags2 == 1)\n"
+        "assert(p.alive == true and p.hp == -5 and p.uid == 1234567)\n"
+        "assert(p.speed == 1.5 and p.mass == 2.25 and p.kind == 3)\n"
+        "p.x, p.score, p.hp, p.alive = 4, 100, 7, false\n"
+        "p.speed, p.mass, p.flags2 = 0.5, 8, 255\n"
+        "assert(p.x == 4 and p.score == 100 and p.hp == 7)\n"
+        "assert(p.alive == false and p.speed == 0.5 and p.mass == 8)\n"
+        "assert(p.flags == 255)\n"
+        "assert(not pcall(function() p.y = 1 end), 'read-only')\n"
+        "assert(not pcall(function() p.kind = 1 end), 'const member')\n"
+        "assert(not pcall(function() p.x = 'nan' end), 'not a number')\n"
+        "assert(p.tag == nil)\n"
+        "obj = p\n");
+
+    auto& p = apollo::to<player&>(L, (lua_getglobal(L, "obj"), -1));
+    lua_pop(L, 1);
+    BOOST_CHECK_EQUAL(p.x, 4);
+    BOOST_CHECK_EQUAL(p.score, 100);
+    BOOST_CHECK_EQUAL(p.hp, 7);
+    BOOST_CHECK_EQUAL(p.alive, false);
+    BOOST_CHECK_EQUAL(p.flags, 255);
+    BOOST_CHECK_EQUAL(p.speed, 0.5f);
+    BOOST_CHECK_EQUAL(p.mass, 8.0);
+
+    apollo::push(L, static_cast<player const*>(&p));
+    lua_setglobal(L, "cobj");
+    apollo::push(L, static_cast<entity*>(nullptr));
+    lua_setglobal(L, "null_entity");
+    require_dostring(L,
+        "assert(cobj.score == 100 and cobj.hp == 7)\n"
+        "assert(not pcall(function() cobj.x = 1 end), 'const object')\n"
+        "assert(not pcall(function() return null_entity.hp end), 'null')\n");
+}
+
+BOOST_AUTO_TEST_CASE(non_primary_base_fields)
+{
+    luaL_requiref(L, "base", &luaopen_base, true);
+    lua_pop(L, 1);
+
+    box b;
+    BOOST_REQUIRE(static_cast<void*>(static_cast<extent*>(&b))
+        != static_cast<void*>(&b));
+
+    lua_pushglobaltable(L);
+    apollo::export_classes(L, -1)
+        .cls<box>("box")
+            .field("id", &shape::id)
+            .field("width", &extent::width)
+            .field("height", &extent::height)
+            .field("depth", &box::depth)
+        .end_cls();
+    lua_pop(L, 1);
+
+    apollo::push(L, &b);
+    lua_setglobal(L, "b");
+    require_dostring(L,
+        "assert(b.id == 1 and b.width == 2.5)\n"
+        "assert(b.height == 3 and b.depth == 4)\n"
+        "b.id, b.width, b.height, b.depth = 10, 20.5, 30, 40\n");
+    BOOST_CHECK_EQUAL(b.id, 10);
+    BOOST_CHECK_EQUAL(b.width, 20.5);
+    BOOST_CHECK_EQUAL(b.height, 30);
+    BOOST_CHECK_EQUAL(b.depth, 40);
+}
+
 #include "test_suffix.hpp"
@@ -0,0 +1,112 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+// Converters for C++17 standard library types. This test is compiled as C++17
+// (see CMakeLists.txt), unlike the rest of apollo.
+
+#include <apollo/builtin_types.hpp>
+#include <apollo/optional_converters.hpp>
+#include <apollo/to_raw_function.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#ifndef APOLLO_HAS_STD_STRING_VIEW
+#   error std::string_view support not detected in C++17 mode.
+#endif
+#ifndef APOLLO_HAS_STD_OPTIONAL
+#   error std::optional support not detected in C++17 mode.
+#endif
+
+#include "test_prefix.hpp"
+
+namespace {
+
+std::size_t count_a(std::string_view s)
+{
+    return static_cast<std::size_t>(std::count(s.begin(), s.end(), 'a'));
+}
+
+int width_or_default(std::optional<int> width)
+{
+    return width.value_or(-1);
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(string_view_converter)
+{
+    static_assert(apollo::detail::lua_type_id<std::string_view>::value
+        == LUA_TSTRING, "std::string_view not detected as string");
+
+    auto const& str = "abc\0def";
+    apollo::push(L, std::string_view(str, sizeof(str) - 1));
+    std::size_t len;
+    char const* pushed = lua_tolstring(L, -1, &len);
+    BOOST_CHECK_EQUAL(len, sizeof(str) - 1);
+    BOOST_CHECK_EQUAL(std::memcmp(pushed, str, sizeof(str)), 0);
+    BOOST_REQUIRE(apollo::is_convertible<std::string_view>(L, -1));
+    BOOST_CHECK(apollo::to<std::string_view>(L, -1)
+        == std::string_view(str, sizeof(str) - 1));
+    lua_pop(L, 1);
+
+    // The string is borrowed from Lua, not copied.
+    std::string const long_str(100, 'a');
+    apollo::push(L, long_str);
+    auto view = apollo::to<std::string_view>(L, -1);
+    BOOST_CHECK_EQUAL(view.data(), lua_tostring(L, -1));
+    BOOST_CHECK_EQUAL(view.size(), long_str.size());
+    lua_pop(L, 1);
+
+    apollo::push(L, 42);
+    BOOST_CHECK_EQUAL(
+        apollo::n_conversion_steps<std::string_view>(L, -1), 2u);
+    BOOST_CHECK(apollo::to<std::string_view>(L, -1) == "42");
+    apollo::push(L, true);
+    BOOST_CHECK_THROW(
+        apollo::to<std::string_view>(L, -1), apollo::conversion_error);
+    lua_pop(L, 2);
+
+    lua_pushcfunction(L, APOLLO_TO_RAW_FUNCTION(&count_a));
+    apollo::push(L, "banana");
+    lua_call(L, 1, 1);
+    BOOST_CHECK_EQUAL(apollo::to<std::size_t>(L, -1), 3u);
+    lua_pop(L, 1);
+}
+
+BOOST_AUTO_TEST_CASE(std_optional_converter)
+{
+    using opt_t = std::optional<int>;
+    BOOST_CHECK_EQUAL(apollo::push(L, opt_t()), 1);
+    BOOST_CHECK(lua_isnil(L, -1));
+    BOOST_CHECK_EQUAL(apollo::n_conversion_steps<opt_t>(L, -1), 0u);
+    BOOST_CHECK(!apollo::to<opt_t>(L, -1));
+    lua_pop(L, 1);
+
+    apollo::push(L, opt_t(42));
+    BOOST_CHECK_EQUAL(lua_tointeger(L, -1), 42);
+    BOOST_CHECK_EQUAL(apollo::n_conversion_steps<opt_t>(L, -1), 1u);
+    BOOST_CHECK(apollo::to<opt_t>(L, -1) == opt_t(42));
+    lua_pop(L, 1);
+
+    apollo::push(L, "foo");
+    BOOST_CHECK_EQUAL(apollo::n_conversion_steps<opt_t>(L, -1),
+        apollo::no_conversion);
+    BOOST_CHECK_THROW(apollo::to<opt_t>(L, -1),
+        apollo::to_cpp_conversion_error);
+    lua_pop(L, 1);
+
+    lua_pushcfunction(L, APOLLO_TO_RAW_FUNCTION(&width_or_default));
+    lua_pushvalue(L, -1);
+    lua_call(L, 0, 1);
+    BOOST_CHECK_EQUAL(lua_tointeger(L, -1), -1);
+    lua_pop(L, 1);
+    apollo::push(L, 5);
+    lua_call(L, 1, 1);
+    BOOST_CHECK_EQUAL(lua_tointeger(L, -1), 5);
+    lua_pop(L, 1);
+}
+
+#include "test_suffix.hpp"
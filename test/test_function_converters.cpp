@@ -63,6 +63,12 @@ struct test_struct {
         return func4(a, s, d, b);
     }
 };
+
+// Distinct member function types for many_function_types.
+template <int N>
+struct numbered {
+    int get() const { return N; }
+};
 } // anonymous namespace
 
 namespace apollo {
@@ -84,6 +90,21 @@ namespace apollo {
     struct converter<test_struct const&>: converter<test_struct&> {
         using to_type = test_struct const&;
     };
+
+    template <int N>
+    struct converter<numbered<N> const&>
+        : converter_base<converter<numbered<N> const&>> {
+
+        static unsigned n_conversion_steps(lua_State* L, int idx)
+        {
+            return lua_isuserdata(L, idx) ? 0 : no_conversion;
+        }
+
+        static numbered<N> const& to(lua_State* L, int idx)
+        {
+            return *static_cast<numbered<N>*>(lua_touserdata(L, idx));
+        }
+    };
 } // namespace apollo
 
 #include "test_prefix.hpp"
@@ -312,6 +333,80 @@ BOOST_AUTO_TEST_CASE(func_obj)
     check_func(L);
 }
 
+BOOST_AUTO_TEST_CASE(func_obj_unwrap)
+{
+    g_n_calls = 0;
+    using std_fn_t = std::function<char const*(int)>;
+    using boost_fn_t = boost::function<char const*(int)>;
+
+    // Function objects of another type but the same signature are wrapped
+    // directly instead of being called through Lua.
+    apollo::push(L, boost_fn_t(&func1));
+    auto const from_boost = apollo::to<std_fn_t>(L, -1);
+    lua_pop(L, 1);
+    BOOST_REQUIRE(from_boost.target<boost_fn_t>());
+    BOOST_CHECK_EQUAL(
+        *from_boost.target<boost_fn_t>()->target<char const*(*)(int)>(),
+        &func1);
+    BOOST_CHECK_EQUAL(from_boost(42), std::string("foo"));
+    BOOST_CHECK_EQUAL(g_n_calls, 1u);
+
+    apollo::push(L, std_fn_t(&func1));
+    auto const from_std = apollo::to<boost_fn_t>(L, -1);
+    lua_pop(L, 1);
+    BOOST_REQUIRE(from_std.target<std_fn_t>());
+    BOOST_CHECK_EQUAL(from_std(42), std::string("foo"));
+    BOOST_CHECK_EQUAL(g_n_calls, 2u);
+
+    // A different signature still needs a call through Lua.
+    apollo::push(L, std_fn_t(&func1));
+    auto const other_sig = apollo::to<std::function<std::string(int)>>(L, -1);
+    lua_pop(L, 1);
+    BOOST_CHECK(other_sig.target<apollo::lua_callable<std::string(int)>>());
+    BOOST_CHECK_EQUAL(other_sig(42), "foo");
+    BOOST_CHECK_EQUAL(g_n_calls, 3u);
+}
+
+
+static void check_numbered(lua_State*, std::integral_constant<int, 0>) {}
+
+template <int N>
+static void check_numbered(lua_State* L, std::integral_constant<int, N>)
+{
+    check_numbered(L, std::integral_constant<int, N - 1>());
+    apollo::push(L, &numbered<N>::get);
+    BOOST_CHECK(apollo::to<decltype(&numbered<N>::get)>(L, -1)
+        == &numbered<N>::get);
+    BOOST_CHECK(!apollo::is_convertible<decltype(&numbered<N - 1>::get)>(
+        L, -1));
+    lua_pop(L, 1);
+}
+
+BOOST_AUTO_TEST_CASE(many_function_types)
+{
+    // More function types than fit into the initial function type table.
+    check_numbered(L, std::integral_constant<int, 100>());
+}
+
+BOOST_AUTO_TEST_CASE(folded_entry_points)
+{
+    // Identical code folding can give functions of different types the same
+    // entry point. Simulate this by replacing the type upvalue.
+    using long_fn = long(*)(long);
+    using llong_fn = long long(*)(long long);
+    apollo::push(L, static_cast<long_fn>(nullptr));
+    lua_CFunction const entry_point = lua_tocfunction(L, -1);
+    BOOST_VERIFY(lua_getupvalue(L, -1, apollo::detail::fn_upval_fn));
+    lua_pushlightuserdata(L, const_cast<boost::typeindex::type_info*>(
+        &boost::typeindex::type_id<llong_fn>().type_info()));
+    lua_pushcclosure(L, entry_point, 2);
+
+    BOOST_CHECK(apollo::is_convertible<long_fn>(L, -2));
+    BOOST_CHECK(!apollo::is_convertible<llong_fn>(L, -2));
+    BOOST_CHECK(apollo::is_convertible<llong_fn>(L, -1));
+    BOOST_CHECK(!apollo::is_convertible<long_fn>(L, -1));
+    lua_pop(L, 2);
+}
 
 BOOST_AUTO_TEST_CASE(mem_func)
 {
@@ -84,4 +84,18 @@ BOOST_AUTO_TEST_CASE(implicit_ctor_conversion)
     BOOST_CHECK_EQUAL(foo.i, foo_cls::got_bar_cls);
 }
 
+BOOST_AUTO_TEST_CASE(shared_registry_implicit_ctor)
+{
+    apollo::shared_class_registry classes;
+    classes.register_class<foo_cls>();
+    apollo::add_implicit_ctor(classes, &apollo::ctor_wrapper<foo_cls, int>);
+    classes.freeze();
+    classes.attach(L);
+
+    lua_pushinteger(L, 42);
+    BOOST_REQUIRE(apollo::is_convertible<foo_cls const&>(L, -1));
+    BOOST_CHECK_EQUAL(apollo::to<foo_cls const&>(L, -1).get().i, 42);
+    lua_pop(L, 1);
+}
+
 #include "test_suffix.hpp"
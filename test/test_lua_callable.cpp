@@ -0,0 +1,145 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include <apollo/builtin_types.hpp>
+#include <apollo/error.hpp>
+#include <apollo/function.hpp>
+#include <apollo/lua_callable.hpp>
+#include <apollo/stack_balance.hpp>
+#include <apollo/to_raw_function.hpp>
+#include <apollo/tuple_converters.hpp>
+
+#include <boost/exception/get_error_info.hpp>
+
+#include "test_prefix.hpp"
+
+namespace {
+
+int call_twice(apollo::lua_callable<int(int)> const& f, int x)
+{
+    return f(f(x));
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(lua_callable_call)
+{
+    luaL_requiref(L, "base", &luaopen_base, true);
+    lua_pop(L, 1);
+    apollo::stack_balance balance(L);
+    require_dostring(L,
+        "n_calls = 0\n"
+        "function inc(x) n_calls = n_calls + 1; return x + 1 end\n"
+        "function sum_product(a, b) return a + b, a * b end\n"
+        "function fail(msg) error(msg, 0) end\n"
+        "function nothing() end");
+
+    lua_getglobal(L, "inc");
+    using callable_t = apollo::lua_callable<int(int)>;
+    BOOST_REQUIRE(apollo::is_convertible<callable_t>(L, -1));
+    auto const inc = apollo::to<callable_t>(L, -1);
+    lua_pop(L, 1);
+    BOOST_CHECK(!inc.empty());
+    BOOST_CHECK_EQUAL(inc.L(), L);
+    BOOST_CHECK_EQUAL(inc(41), 42);
+    int result = 0;
+    BOOST_CHECK_EQUAL(inc.try_call(&result, 1), LUA_OK);
+    BOOST_CHECK_EQUAL(result, 2);
+    BOOST_CHECK_EQUAL(inc.try_call(nullptr, 1), LUA_OK);
+
+    lua_getglobal(L, "sum_product");
+    apollo::lua_callable<std::pair<int, int>(int, int)> sum_product(L, -1);
+    lua_pop(L, 1);
+    BOOST_CHECK(sum_product(3, 4) == std::make_pair(7, 12));
+
+    lua_getglobal(L, "fail");
+    apollo::lua_callable<void(char const*)> fail(L, -1);
+    apollo::push(L, fail);
+    BOOST_CHECK(lua_rawequal(L, -1, -2));
+    lua_pop(L, 2);
+    BOOST_CHECK_EQUAL(fail.try_call(nullptr, "oops"), LUA_ERRRUN);
+    BOOST_CHECK_EXCEPTION(fail("oops"), apollo::lua_api_error,
+        [](apollo::lua_api_error const& e) {
+            return *boost::get_error_info<apollo::errinfo::lua_msg>(e)
+                == "oops";
+        });
+
+    // Errors from converting the return value are still thrown.
+    lua_getglobal(L, "nothing");
+    apollo::lua_callable<int()> nothing(L, -1);
+    lua_pop(L, 1);
+    BOOST_CHECK_THROW(nothing(), apollo::to_cpp_conversion_error);
+
+    lua_getglobal(L, "n_calls");
+    BOOST_CHECK_EQUAL(lua_tointeger(L, -1), 3);
+    lua_pop(L, 1);
+}
+
+BOOST_AUTO_TEST_CASE(lua_callable_msg_handler)
+{
+    luaL_requiref(L, "base", &luaopen_base, true);
+    lua_pop(L, 1);
+    apollo::stack_balance balance(L);
+    require_dostring(L, "function fail() error('x', 0) end");
+    lua_getglobal(L, "fail");
+    apollo::lua_callable<void()> without_msgh(L, -1);
+
+    lua_pop(L, 1);
+    require_dostring(L,
+        "n_handled = 0\n"
+        "function handler(msg)\n"
+        "  n_handled = n_handled + 1\n"
+        "  return 'handled'\n"
+        "end");
+    lua_getglobal(L, "handler");
+    apollo::set_error_msg_handler(L);
+    lua_getglobal(L, "fail");
+    apollo::lua_callable<void()> with_msgh(L, -1);
+    lua_pop(L, 1);
+
+    // The message handler is cached on construction.
+    BOOST_CHECK_EXCEPTION(without_msgh(), apollo::lua_api_error,
+        [](apollo::lua_api_error const& e) {
+            return *boost::get_error_info<apollo::errinfo::lua_msg>(e) == "x";
+        });
+    BOOST_CHECK_EXCEPTION(with_msgh(), apollo::lua_api_error,
+        [](apollo::lua_api_error const& e) {
+            return *boost::get_error_info<apollo::errinfo::lua_msg>(e)
+                == "handled";
+        });
+    BOOST_CHECK_EQUAL(with_msgh.try_call(nullptr), LUA_ERRRUN);
+    lua_getglobal(L, "n_handled");
+    BOOST_CHECK_EQUAL(lua_tointeger(L, -1), 2);
+    lua_pop(L, 1);
+
+    // Copies share the function and handler.
+    auto const copy = with_msgh;
+    BOOST_CHECK_EQUAL(copy.try_call(nullptr), LUA_ERRRUN);
+    lua_pushnil(L);
+    apollo::set_error_msg_handler(L);
+}
+
+BOOST_AUTO_TEST_CASE(lua_callable_parameter)
+{
+    luaL_requiref(L, "base", &luaopen_base, true);
+    lua_pop(L, 1);
+    lua_pushcfunction(L, APOLLO_TO_RAW_FUNCTION(&call_twice));
+    lua_setglobal(L, "call_twice");
+    require_dostring(L,
+        "assert(call_twice(function(x) return x * 3 end, 2) == 18)\n"
+        "local callable = setmetatable({}, {\n"
+        "    __call = function(self, x) return x - 1 end})\n"
+        "assert(call_twice(callable, 2) == 0)\n"
+        "assert(not pcall(call_twice, 1, 2))");
+
+    // std::function obtained from a Lua function wraps a lua_callable.
+    require_dostring(L, "function double(x) return x * 2 end");
+    lua_getglobal(L, "double");
+    auto const f = apollo::to<std::function<int(int)>>(L, -1);
+    lua_pop(L, 1);
+    BOOST_CHECK_EQUAL(f(21), 42);
+    BOOST_CHECK(f.target<apollo::lua_callable<int(int)>>());
+}
+
+#include "test_suffix.hpp"
@@ -3,9 +3,11 @@
 // See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
 
 #include <apollo/builtin_types.hpp>
+#include <apollo/closing_lstate.hpp>
 #include <apollo/error.hpp>
 #include <apollo/gc.hpp>
 #include <apollo/lapi.hpp>
+#include <apollo/memory_pool.hpp>
 
 namespace {
 
@@ -21,6 +23,11 @@ struct test_cls {
 
 unsigned test_cls::n_destructions = 0;
 
+void* failing_chunk_alloc(std::size_t)
+{
+    return nullptr;
+}
+
 } // Anonymous namespace
 
 #include "test_prefix.hpp"
@@ -88,6 +95,33 @@ BOOST_AUTO_TEST_CASE(gc)
     BOOST_CHECK_EQUAL(test_cls::n_destructions, 4u);
 }
 
+BOOST_AUTO_TEST_CASE(gc_shared_metatable)
+{
+    test_cls::n_destructions = 0;
+
+    apollo::push_gc_object(L, test_cls(1));
+    apollo::push_gc_object(L, test_cls(2));
+    BOOST_CHECK_EQUAL(test_cls::n_destructions, 2u);
+
+    // All objects of the same type share a single metatable.
+    BOOST_REQUIRE(lua_getmetatable(L, -2));
+    BOOST_REQUIRE(lua_getmetatable(L, -2));
+    BOOST_CHECK(lua_rawequal(L, -1, -2));
+    lua_pop(L, 2);
+
+    // ... but objects of different types do not.
+    apollo::push_gc_object(L, std::string("foo"));
+    BOOST_REQUIRE(lua_getmetatable(L, -1));
+    BOOST_REQUIRE(lua_getmetatable(L, -3));
+    BOOST_CHECK(!lua_rawequal(L, -1, -2));
+    lua_pop(L, 2);
+
+    lua_pop(L, 3);
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    BOOST_CHECK_EQUAL(test_cls::n_destructions, 4u);
+}
+
 static int testthrower(lua_State* L)
 {
     apollo::exceptions_to_lua_errors(L, [](int v) -> void {
@@ -106,4 +140,72 @@ BOOST_AUTO_TEST_CASE(errors)
     lua_pop(L, 1);
 }
 
+BOOST_AUTO_TEST_CASE(memory_pool)
+{
+    apollo::memory_pool pool;
+    {
+        apollo::closing_lstate pooled_L(pool);
+        BOOST_REQUIRE(pooled_L.get());
+        luaL_openlibs(pooled_L);
+        BOOST_REQUIRE_EQUAL(luaL_loadstring(pooled_L,
+            "local t = {}\n"
+            "for i = 1, 1000 do t[i] = {i, tostring(i)} end\n"
+            "local big = string.rep('x', 100000)\n"
+            "t = nil\n"
+            "collectgarbage()\n"
+            "return #big"), LUA_OK);
+        BOOST_REQUIRE_EQUAL(lua_pcall(pooled_L, 0, 1, 0), LUA_OK);
+        BOOST_CHECK_EQUAL(lua_tointeger(pooled_L, -1), 100000);
+        lua_pop(pooled_L, 1);
+        BOOST_CHECK_GT(pool.n_blocks(), 0u);
+        BOOST_CHECK_GT(pool.n_chunks(), 0u);
+
+        std::size_t const n_bytes = pool.n_bytes();
+        lua_newtable(pooled_L);
+        BOOST_CHECK_GT(pool.n_bytes(), n_bytes);
+        lua_pop(pooled_L, 1);
+
+        BOOST_REQUIRE_EQUAL(luaL_loadstring(
+            pooled_L, "return string.rep('x', 100000)"), LUA_OK);
+        pool.set_max_bytes(pool.n_bytes() + 50000);
+        lua_pushvalue(pooled_L, -1);
+        BOOST_CHECK_NE(lua_pcall(pooled_L, 0, 1, 0), LUA_OK);
+        BOOST_CHECK_NE(apollo::to<std::string>(pooled_L, -1).find(
+            "not enough memory"), std::string::npos);
+        lua_pop(pooled_L, 1);
+        pool.set_max_bytes(0);
+        BOOST_CHECK_EQUAL(lua_pcall(pooled_L, 0, 1, 0), LUA_OK);
+        lua_pop(pooled_L, 1);
+    }
+    BOOST_CHECK_EQUAL(pool.n_blocks(), 0u);
+    BOOST_CHECK_EQUAL(pool.n_bytes(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(memory_pool_failed_shrink)
+{
+    apollo::memory_pool pool;
+    pool.set_chunk_allocator(&failing_chunk_alloc);
+    std::size_t const big = apollo::memory_pool::max_pooled_size * 4;
+    std::size_t const small = apollo::memory_pool::max_pooled_size / 2;
+
+    void* p = apollo::memory_pool::lua_alloc(&pool, nullptr, 0, big);
+    BOOST_REQUIRE(p);
+    BOOST_CHECK_EQUAL(apollo::memory_pool::lua_alloc(
+        &pool, nullptr, 0, small), nullptr);
+
+    // No pooled block is available, so shrinking keeps the malloc()ed block.
+    BOOST_CHECK_EQUAL(apollo::memory_pool::lua_alloc(&pool, p, big, small), p);
+    BOOST_CHECK_EQUAL(pool.n_blocks(), 1u);
+    BOOST_CHECK_EQUAL(pool.n_bytes(), small);
+    BOOST_CHECK_EQUAL(pool.n_chunks(), 0u);
+
+    // It must be given back to free(), not put into a free list.
+    BOOST_CHECK_EQUAL(
+        apollo::memory_pool::lua_alloc(&pool, p, small, 0), nullptr);
+    BOOST_CHECK_EQUAL(pool.n_blocks(), 0u);
+    BOOST_CHECK_EQUAL(pool.n_bytes(), 0u);
+    BOOST_CHECK_EQUAL(apollo::memory_pool::lua_alloc(
+        &pool, nullptr, 0, small), nullptr);
+}
+
 #include "test_suffix.hpp"
@@ -0,0 +1,134 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include <apollo/map_converters.hpp>
+#include <apollo/sequence_converters.hpp>
+#include <apollo/stack_balance.hpp>
+
+#include "test_prefix.hpp"
+
+namespace {
+
+template <typename Map>
+void check_roundtrip(lua_State* L, Map const& map)
+{
+    apollo::stack_balance balance(L);
+    apollo::push(L, map);
+    BOOST_REQUIRE_EQUAL(lua_type(L, -1), LUA_TTABLE);
+    BOOST_REQUIRE(apollo::is_convertible<Map>(L, -1));
+    BOOST_CHECK(apollo::to<Map>(L, -1) == map);
+    BOOST_CHECK(apollo::to<Map const&>(L, -1) == map);
+    lua_pop(L, 1);
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(map_roundtrip)
+{
+    check_roundtrip(L, std::map<std::string, int>{{"a", 1}, {"b", 2}});
+    check_roundtrip(L, std::map<int, bool>());
+    check_roundtrip(L, std::unordered_map<std::string, double>{
+        {"x", 0.5}, {"y", -2}, {"", 1e10}});
+    check_roundtrip(L, boost::container::flat_map<int, std::string>{
+        {3, "c"}, {1, "a"}, {2, "b"}});
+    check_roundtrip(L, std::map<std::string, std::vector<int>>{
+        {"primes", {2, 3, 5}}, {"none", {}}});
+}
+
+BOOST_AUTO_TEST_CASE(map_conversion_steps)
+{
+    apollo::stack_balance balance(L);
+    using smap = std::map<std::string, int>;
+
+    lua_pushinteger(L, 1);
+    BOOST_CHECK_EQUAL(apollo::n_conversion_steps<smap>(L, -1),
+        apollo::no_conversion);
+    BOOST_CHECK_THROW(apollo::to<smap>(L, -1), apollo::to_cpp_conversion_error);
+    lua_pop(L, 1);
+
+    require_dostring(L, "t = {a = 1, b = 2}");
+    lua_getglobal(L, "t");
+    BOOST_CHECK_EQUAL(apollo::n_conversion_steps<smap>(L, -1), 0u);
+    lua_pop(L, 1);
+
+    require_dostring(L, "t = {a = 1, b = {}}");
+    lua_getglobal(L, "t");
+    BOOST_CHECK_EQUAL(apollo::n_conversion_steps<smap>(L, -1),
+        apollo::no_conversion);
+    BOOST_CHECK_THROW(apollo::to<smap>(L, -1), apollo::to_cpp_conversion_error);
+    lua_pop(L, 1);
+
+    // Number keys must not be converted in place (this would break the
+    // traversal with lua_next()).
+    require_dostring(L, "t = {10, 20, 30, x = 40}");
+    lua_getglobal(L, "t");
+    BOOST_CHECK(apollo::n_conversion_steps<smap>(L, -1) != 0u);
+    BOOST_CHECK(apollo::to<smap>(L, -1)
+        == (smap{{"1", 10}, {"2", 20}, {"3", 30}, {"x", 40}}));
+    BOOST_CHECK((apollo::to<std::unordered_map<std::string, int>>(L, -1).size()
+        == 4u));
+    BOOST_CHECK((apollo::to<boost::container::flat_map<std::string, int>>(
+        L, -1).size() == 4u));
+    BOOST_CHECK_EQUAL(lua_type(L, -1), LUA_TTABLE);
+    lua_pop(L, 1);
+
+    // 1 and "1" are the same std::string key.
+    require_dostring(L, "t = {1, ['1'] = 1}");
+    lua_getglobal(L, "t");
+    auto const m = apollo::to<boost::container::flat_map<std::string, int>>(
+        L, -1);
+    BOOST_CHECK_EQUAL(m.size(), 1u);
+    BOOST_CHECK_EQUAL(m.at("1"), 1);
+    lua_pop(L, 1);
+}
+
+BOOST_AUTO_TEST_CASE(map_visit_table)
+{
+    apollo::stack_balance balance(L);
+    require_dostring(L, "t = {a = 1, b = 2, c = 3}");
+    lua_getglobal(L, "t");
+
+    int sum = 0;
+    std::string keys;
+    apollo::visit_table<std::string, int>(L, -1,
+        [&](std::string const& k, int v) {
+            keys += k;
+            sum += v;
+        });
+    BOOST_CHECK_EQUAL(sum, 6);
+    BOOST_CHECK_EQUAL(keys.size(), 3u);
+    BOOST_CHECK_EQUAL(lua_gettop(L), 1);
+
+    int n_visited = 0;
+    apollo::visit_table<std::string, int>(L, -1,
+        [&](std::string const&, int) { return ++n_visited < 2; });
+    BOOST_CHECK_EQUAL(n_visited, 2);
+    BOOST_CHECK_EQUAL(lua_gettop(L), 1);
+    lua_pop(L, 1);
+
+    require_dostring(L, "t = {a = 1, b = 'x'}");
+    lua_getglobal(L, "t");
+    BOOST_CHECK_THROW((apollo::visit_table<std::string, int>(L, -1,
+        [](std::string const&, int) {})), apollo::to_cpp_conversion_error);
+    BOOST_CHECK_EQUAL(lua_gettop(L), 1);
+    lua_pop(L, 1);
+
+    lua_pushboolean(L, true);
+    BOOST_CHECK_THROW((apollo::visit_table<std::string, int>(L, -1,
+        [](std::string const&, int) {})), apollo::to_cpp_conversion_error);
+    lua_pop(L, 1);
+
+    // Borrowed keys are valid during the call, also if they are numbers.
+    require_dostring(L, "t = {[1] = 1, b = 2}");
+    lua_getglobal(L, "t");
+    std::map<std::string, int> copied;
+    apollo::visit_table<boost::string_ref, int>(L, -1,
+        [&](boost::string_ref k, int v) { copied[k.to_string()] = v; });
+    BOOST_CHECK_EQUAL(copied.size(), 2u);
+    BOOST_CHECK_EQUAL(copied["1"], 1);
+    BOOST_CHECK_EQUAL(copied["b"], 2);
+    lua_pop(L, 1);
+}
+
+#include "test_suffix.hpp"
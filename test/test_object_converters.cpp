@@ -4,6 +4,7 @@
 
 #include <apollo/builtin_types.hpp>
 #include <apollo/class.hpp>
+#include <apollo/closing_lstate.hpp>
 #include <apollo/ctor_wrapper.hpp>
 #include <apollo/lapi.hpp>
 #include <apollo/function.hpp>
@@ -55,6 +56,18 @@ struct derived_cls: foo_cls, bar_cls {
     }
 };
 
+struct left_cls: foo_cls {
+    left_cls(): foo_cls(1) {}
+};
+
+struct right_cls: foo_cls {
+    right_cls(): foo_cls(2) {}
+};
+
+struct diamond_cls: left_cls, right_cls {};
+
+struct deep_cls: diamond_cls {};
+
 foo_cls&& take_foo()
 {
     static foo_cls foo(0);
@@ -195,6 +208,126 @@ BOOST_AUTO_TEST_CASE(derived_converter)
     lua_pop(L, 1);
 }
 
+BOOST_AUTO_TEST_CASE(indirect_bases)
+{
+    apollo::register_class<foo_cls>(L);
+    apollo::register_class<left_cls, foo_cls>(L);
+    apollo::register_class<right_cls, foo_cls>(L);
+    apollo::register_class<diamond_cls, left_cls, right_cls>(L);
+    apollo::register_class<deep_cls, diamond_cls>(L);
+
+    deep_cls deep;
+    apollo::push(L, &deep);
+    BOOST_CHECK_EQUAL(apollo::to<diamond_cls*>(L, -1), &deep);
+    BOOST_CHECK_EQUAL(apollo::to<left_cls&>(L, -1).i, 1);
+    BOOST_CHECK_EQUAL(apollo::to<right_cls&>(L, -1).i, 2);
+    BOOST_CHECK_EQUAL(
+        apollo::to<right_cls*>(L, -1), static_cast<right_cls*>(&deep));
+
+    // foo_cls is contained twice, at the same depth.
+    BOOST_CHECK_THROW(
+        apollo::to<foo_cls*>(L, -1), apollo::to_cpp_conversion_error);
+    lua_pop(L, 1);
+}
+
+BOOST_AUTO_TEST_CASE(identity_cache)
+{
+    apollo::register_class<foo_cls>(L);
+    foo_cls foo(1), other(2);
+
+    // Disabled by default.
+    apollo::push(L, &foo);
+    apollo::push(L, &foo);
+    BOOST_CHECK(!lua_rawequal(L, -1, -2));
+    lua_pop(L, 2);
+
+    apollo::enable_identity_cache<foo_cls>(L);
+    apollo::push(L, &foo);
+    apollo::push(L, &foo);
+    BOOST_CHECK(lua_rawequal(L, -1, -2));
+    apollo::push(L, &other);
+    BOOST_CHECK(!lua_rawequal(L, -1, -2));
+    BOOST_CHECK_EQUAL(apollo::to<foo_cls*>(L, -1), &other);
+
+    // Different pointer types get different instances.
+    apollo::push(L, static_cast<foo_cls const*>(&foo));
+    BOOST_CHECK(!lua_rawequal(L, -1, -3));
+    BOOST_CHECK(!apollo::is_convertible<foo_cls*>(L, -1));
+    lua_pop(L, 2);
+
+    apollo::evict_cached_instance(L, &foo);
+    apollo::push(L, &foo);
+    BOOST_CHECK(!lua_rawequal(L, -1, -2));
+    apollo::push(L, &foo);
+    BOOST_CHECK(lua_rawequal(L, -1, -2));
+    lua_pop(L, 4);
+
+    // The cache does not keep instances alive.
+    unsigned const n_destructions = foo_cls::n_destructions;
+    auto const shared_foo = std::make_shared<foo_cls>(3);
+    apollo::push(L, shared_foo);
+    lua_pop(L, 1);
+    BOOST_CHECK_EQUAL(shared_foo.use_count(), 2);
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    BOOST_CHECK_EQUAL(shared_foo.use_count(), 1);
+    BOOST_CHECK_EQUAL(foo_cls::n_destructions, n_destructions);
+    apollo::push(L, shared_foo);
+    apollo::push(L, shared_foo);
+    BOOST_CHECK(lua_rawequal(L, -1, -2));
+    BOOST_CHECK_EQUAL(shared_foo.use_count(), 2);
+    lua_pop(L, 2);
+}
+
+BOOST_AUTO_TEST_CASE(shared_registry)
+{
+    apollo::shared_class_registry classes;
+    classes.register_class<foo_cls>();
+    classes.register_class<bar_cls>();
+    classes.register_class<derived_cls, foo_cls, bar_cls>();
+    classes.enable_identity_cache<bar_cls>();
+    classes.freeze();
+    BOOST_CHECK(classes.is_frozen());
+
+    apollo::closing_lstate other_L;
+    for (lua_State* L_: {L, other_L.get()}) {
+        classes.attach(L_);
+        BOOST_CHECK_EQUAL(apollo::detail::registered_classes(L_).size(), 3u);
+
+        derived_cls drv(1, 2);
+        apollo::push(L_, &drv);
+        BOOST_CHECK_EQUAL(apollo::to<bar_cls*>(L_, -1), &drv);
+        BOOST_CHECK_EQUAL(apollo::to<foo_cls&>(L_, -1).i, 1);
+        lua_pop(L_, 1);
+
+        bar_cls bar;
+        apollo::push(L_, &bar);
+        apollo::push(L_, &bar);
+        BOOST_CHECK(lua_rawequal(L_, -1, -2));
+        lua_pop(L_, 2);
+    }
+
+    BOOST_CHECK_EQUAL(
+        &apollo::detail::registered_class<foo_cls>(L),
+        &apollo::detail::registered_class<foo_cls>(other_L));
+
+    // Metatables are still per state.
+    apollo::push_class_metatable<foo_cls>(L);
+    apollo::push_class_metatable<foo_cls>(other_L);
+    BOOST_CHECK_NE(lua_topointer(L, -1), lua_topointer(other_L, -1));
+    lua_pop(L, 1);
+    lua_pop(other_L, 1);
+
+    // Local classes can derive from shared ones.
+    apollo::register_class<left_cls, foo_cls>(L);
+    left_cls left;
+    apollo::push(L, &left);
+    BOOST_CHECK_EQUAL(apollo::to<foo_cls&>(L, -1).i, 1);
+    lua_pop(L, 1);
+    BOOST_CHECK(!apollo::detail::registered_class_opt(
+        other_L, apollo::detail::static_class_id<left_cls>::id));
+}
+
 BOOST_AUTO_TEST_CASE(memfns)
 {
     apollo::register_class<foo_cls>(L);
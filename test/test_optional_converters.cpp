@@ -0,0 +1,99 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include <apollo/builtin_types.hpp>
+#include <apollo/optional_converters.hpp>
+#include <apollo/overload.hpp>
+#include <apollo/stack_balance.hpp>
+#include <apollo/to_raw_function.hpp>
+
+#include "test_prefix.hpp"
+
+namespace {
+
+int width_or_default(boost::optional<int> const& width)
+{
+    return width ? *width : -1;
+}
+
+boost::optional<std::string> find_name(int id)
+{
+    if (id == 1)
+        return std::string("one");
+    return boost::none;
+}
+
+char const* overload_int(int) { return "int"; }
+char const* overload_optional(boost::optional<std::string> const&)
+{
+    return "optional";
+}
+
+template <typename Optional>
+void check_optional(lua_State* L)
+{
+    apollo::stack_balance balance(L);
+    BOOST_CHECK_EQUAL(apollo::push(L, Optional()), 1);
+    BOOST_CHECK(lua_isnil(L, -1));
+    BOOST_CHECK_EQUAL(apollo::n_conversion_steps<Optional>(L, -1), 0u);
+    BOOST_CHECK(!apollo::to<Optional>(L, -1));
+    lua_pop(L, 1);
+
+    // A missing value (none) is empty, too.
+    BOOST_CHECK_EQUAL(
+        apollo::n_conversion_steps<Optional>(L, lua_gettop(L) + 1), 0u);
+    BOOST_CHECK(!apollo::to<Optional>(L, lua_gettop(L) + 1));
+
+    apollo::push(L, Optional(42));
+    BOOST_CHECK_EQUAL(lua_tointeger(L, -1), 42);
+    BOOST_CHECK_EQUAL(apollo::n_conversion_steps<Optional>(L, -1), 1u);
+    BOOST_CHECK(apollo::to<Optional>(L, -1) == Optional(42));
+    BOOST_CHECK(apollo::to<Optional const&>(L, -1) == Optional(42));
+    BOOST_CHECK(apollo::unchecked_to<Optional>(L, -1) == Optional(42));
+    lua_pop(L, 1);
+
+    apollo::push(L, "foo");
+    BOOST_CHECK_EQUAL(apollo::n_conversion_steps<Optional>(L, -1),
+        apollo::no_conversion);
+    BOOST_CHECK_THROW(apollo::to<Optional>(L, -1),
+        apollo::to_cpp_conversion_error);
+    lua_pop(L, 1);
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(optional_converter)
+{
+    check_optional<boost::optional<int>>(L);
+#ifdef APOLLO_HAS_STD_OPTIONAL
+    check_optional<std::optional<int>>(L);
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(optional_functions)
+{
+    luaL_requiref(L, "base", &luaopen_base, true);
+    lua_pop(L, 1);
+    lua_pushcfunction(L, APOLLO_TO_RAW_FUNCTION(&width_or_default));
+    lua_setglobal(L, "width_or_default");
+    lua_pushcfunction(L, APOLLO_TO_RAW_FUNCTION(&find_name));
+    lua_setglobal(L, "find_name");
+    apollo::push(L, apollo::make_overloadset(
+        &overload_int, &overload_optional));
+    lua_setglobal(L, "overloaded");
+
+    require_dostring(L,
+        "assert(width_or_default(5) == 5)\n"
+        "assert(width_or_default(nil) == -1)\n"
+        "assert(width_or_default() == -1)\n"
+        "assert(not pcall(width_or_default, {}))\n"
+        "assert(find_name(1) == 'one')\n"
+        "assert(find_name(2) == nil)\n"
+        "assert(select('#', find_name(2)) == 1)\n"
+        "assert(overloaded(1) == 'int')\n"
+        "assert(overloaded(nil) == 'optional')\n"
+        "assert(overloaded('x') == 'optional')");
+}
+
+#include "test_suffix.hpp"
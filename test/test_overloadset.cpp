@@ -4,8 +4,10 @@
 
 #include <apollo/builtin_types.hpp>
 #include <apollo/default_argument.hpp>
+#include <apollo/implicit_ctor.hpp>
 #include <apollo/lapi.hpp>
 #include <apollo/overload.hpp>
+#include <apollo/static_overload.hpp>
 #include <apollo/to_raw_function.hpp>
 
 #include <iostream>
@@ -45,6 +47,35 @@ static void proc1s(std::string const& s)
     ++g_n_s_calls;
 }
 
+static void proc1c(char c)
+{
+    BOOST_CHECK_EQUAL(c, 'x');
+    ++g_n_calls;
+}
+
+struct tag {
+    int value;
+};
+
+tag make_tag(int value)
+{
+    return {value};
+}
+
+static char const* overload_bool(bool) { return "bool"; }
+static char const* overload_tag(tag const&) { return "tag"; }
+
+// Calls the function at the top of the stack with 42 and returns the result.
+static std::string call_with_42(lua_State* L)
+{
+    lua_pushvalue(L, -1);
+    lua_pushinteger(L, 42);
+    apollo::pcall(L, 1, 1);
+    std::string const result = apollo::to<std::string>(L, -1);
+    lua_pop(L, 1);
+    return result;
+}
+
 static void proc_si(std::string const& s, int i)
 {
     BOOST_CHECK_EQUAL(s, "foo");
@@ -271,6 +302,132 @@ BOOST_AUTO_TEST_CASE(mixed_length)
     BOOST_CHECK_EQUAL(g_n_is_calls, 1u);
 }
 
+BOOST_AUTO_TEST_CASE(resolution_cache)
+{
+    reset_calls();
+    apollo::push(L, apollo::make_overloadset(&proc1, &proc1s));
+    auto stats = apollo::get_overload_cache_stats(L, -1);
+    BOOST_CHECK(stats.enabled);
+    BOOST_CHECK_EQUAL(stats.n_hits, 0u);
+    BOOST_CHECK_EQUAL(stats.n_misses, 0u);
+
+    for (int i = 0; i < 3; ++i) {
+        lua_pushvalue(L, -1);
+        lua_pushinteger(L, 42);
+        apollo::pcall(L, 1, 0);
+        lua_pushvalue(L, -1);
+        lua_pushliteral(L, "foo");
+        apollo::pcall(L, 1, 0);
+    }
+    BOOST_CHECK_EQUAL(g_n_i_calls, 3u);
+    BOOST_CHECK_EQUAL(g_n_s_calls, 3u);
+    stats = apollo::get_overload_cache_stats(L, -1);
+    BOOST_CHECK_EQUAL(stats.n_hits, 4u);
+    BOOST_CHECK_EQUAL(stats.n_misses, 2u);
+
+    // Failed resolutions must not be cached.
+    lua_pushvalue(L, -1);
+    lua_pushnil(L);
+    check_none_viable(L, 1);
+    lua_pushvalue(L, -1);
+    lua_pushnil(L);
+    check_none_viable(L, 1);
+    stats = apollo::get_overload_cache_stats(L, -1);
+    BOOST_CHECK_EQUAL(stats.n_hits, 4u);
+    BOOST_CHECK_EQUAL(stats.n_misses, 4u);
+    lua_pop(L, 1);
+
+    // Whether a number is convertible to char depends on its value.
+    apollo::push(L, apollo::make_overloadset(&proc1, &proc1c));
+    lua_pushvalue(L, -1);
+    lua_pushinteger(L, 42);
+    apollo::pcall(L, 1, 0);
+    BOOST_CHECK_EQUAL(g_n_i_calls, 4u);
+    lua_pushvalue(L, -1);
+    lua_pushliteral(L, "x");
+    apollo::pcall(L, 1, 0);
+    BOOST_CHECK_EQUAL(g_n_calls, 5u);
+    stats = apollo::get_overload_cache_stats(L, -1);
+    BOOST_CHECK(!stats.enabled);
+    BOOST_CHECK_EQUAL(stats.n_hits, 0u);
+    BOOST_CHECK_EQUAL(stats.n_misses, 0u);
+    lua_pop(L, 1);
+
+    apollo::push(L, apollo::make_function(&proc1));
+    BOOST_CHECK_THROW(
+        apollo::get_overload_cache_stats(L, -1),
+        apollo::to_cpp_conversion_error);
+    lua_pop(L, 1);
+}
+
+BOOST_AUTO_TEST_CASE(resolution_cache_implicit_ctor)
+{
+    apollo::register_class<tag>(L);
+    apollo::push(L, apollo::make_overloadset(&overload_bool, &overload_tag));
+    BOOST_CHECK_EQUAL(call_with_42(L), "bool"); // Any value converts to bool.
+    BOOST_CHECK_EQUAL(call_with_42(L), "bool");
+    BOOST_CHECK_EQUAL(apollo::get_overload_cache_stats(L, -1).n_hits, 1u);
+
+    // Numbers now convert to tag, which is better than to bool.
+    apollo::add_implicit_ctor(L, &make_tag);
+    BOOST_CHECK_EQUAL(call_with_42(L), "tag");
+    BOOST_CHECK_EQUAL(call_with_42(L), "tag");
+    lua_pop(L, 1);
+}
+
+BOOST_AUTO_TEST_CASE(static_overloadset)
+{
+    reset_calls();
+    lua_pushcfunction(L, (apollo::make_static_overloadset<
+        APOLLO_STATIC_OVERLOAD(&proc_is), APOLLO_STATIC_OVERLOAD(&proc_si),
+        APOLLO_STATIC_OVERLOAD(&proc1), APOLLO_STATIC_OVERLOAD(&proc1s)>()));
+
+    lua_pushvalue(L, -1);
+    lua_pushliteral(L, "foo");
+    apollo::pcall(L, 1, 0);
+    BOOST_CHECK_EQUAL(g_n_s_calls, 1u);
+
+    lua_pushvalue(L, -1);
+    lua_pushinteger(L, 42);
+    apollo::pcall(L, 1, 0);
+    BOOST_CHECK_EQUAL(g_n_i_calls, 1u);
+
+    lua_pushvalue(L, -1);
+    lua_pushliteral(L, "foo");
+    lua_pushinteger(L, 42);
+    apollo::pcall(L, 2, 0);
+    BOOST_CHECK_EQUAL(g_n_si_calls, 1u);
+
+    lua_pushvalue(L, -1);
+    lua_pushinteger(L, 42);
+    lua_pushliteral(L, "foo");
+    apollo::pcall(L, 2, 0);
+    BOOST_CHECK_EQUAL(g_n_is_calls, 1u);
+
+    // Surplus arguments are ignored if no overload takes all of them.
+    lua_pushvalue(L, -1);
+    lua_pushinteger(L, 42);
+    lua_pushliteral(L, "foo");
+    lua_pushnil(L);
+    apollo::pcall(L, 3, 0);
+    BOOST_CHECK_EQUAL(g_n_is_calls, 2u);
+
+    lua_pushvalue(L, -1);
+    check_none_viable(L, 0);
+
+    lua_pushvalue(L, -1);
+    lua_pushnil(L);
+    check_none_viable(L, 1);
+    lua_pop(L, 1);
+
+    lua_pushcfunction(L, (apollo::make_static_overloadset<
+        APOLLO_STATIC_OVERLOAD(&proc1), APOLLO_STATIC_OVERLOAD(&proc1),
+        APOLLO_STATIC_OVERLOAD(&proc0)>()));
+    lua_pushinteger(L, 42);
+    check_ambiguous(L, 1);
+    BOOST_CHECK_EQUAL(g_n_calls, 1u);
+}
+
 BOOST_AUTO_TEST_CASE(ambigous_overload)
 {
     reset_calls();
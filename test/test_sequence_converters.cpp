@@ -0,0 +1,116 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include <apollo/overload.hpp>
+#include <apollo/sequence_converters.hpp>
+#include <apollo/stack_balance.hpp>
+#include <apollo/to_raw_function.hpp>
+
+#include "test_prefix.hpp"
+
+namespace {
+
+template <typename Seq>
+void check_roundtrip(lua_State* L, Seq const& seq)
+{
+    apollo::stack_balance balance(L);
+    apollo::push(L, seq);
+    BOOST_REQUIRE_EQUAL(lua_type(L, -1), LUA_TTABLE);
+    BOOST_CHECK_EQUAL(lua_rawlen(L, -1), seq.size());
+    BOOST_REQUIRE(apollo::is_convertible<Seq>(L, -1));
+    BOOST_CHECK(apollo::to<Seq>(L, -1) == seq);
+    BOOST_CHECK(apollo::to<Seq const&>(L, -1) == seq);
+    lua_pop(L, 1);
+}
+
+std::size_t sum_sizes(std::vector<std::string> const& strs)
+{
+    std::size_t n = 0;
+    for (auto const& s: strs)
+        n += s.size();
+    return n;
+}
+
+int sum_ints(std::vector<int> const& ns)
+{
+    int sum = 0;
+    for (int n: ns)
+        sum += n;
+    return sum;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(sequence_roundtrip)
+{
+    check_roundtrip(L, std::vector<int>{1, 2, 3});
+    check_roundtrip(L, std::vector<int>());
+    check_roundtrip(L, std::vector<double>{0.5, -1.25, 1e100});
+    check_roundtrip(L, std::vector<bool>{true, false, true});
+    check_roundtrip(L, std::deque<std::string>{"a", "", "foo"});
+    check_roundtrip(L, std::array<unsigned, 3>{{1, 2, 3}});
+    check_roundtrip(
+        L, std::vector<std::vector<int>>{{1}, {}, {2, 3}});
+
+    require_dostring(L, "t = {1, 2, 3, n = 'ignored'}");
+    lua_getglobal(L, "t");
+    BOOST_CHECK(apollo::to<std::vector<short>>(L, -1)
+        == (std::vector<short>{1, 2, 3}));
+    lua_pop(L, 1);
+}
+
+BOOST_AUTO_TEST_CASE(sequence_conversion_steps)
+{
+    apollo::stack_balance balance(L);
+    using ivec = std::vector<int>;
+    using iarr = std::array<int, 2>;
+
+    lua_pushinteger(L, 1);
+    BOOST_CHECK_EQUAL(apollo::n_conversion_steps<ivec>(L, -1),
+        apollo::no_conversion);
+    BOOST_CHECK_THROW(apollo::to<ivec>(L, -1), apollo::to_cpp_conversion_error);
+    lua_pop(L, 1);
+
+    require_dostring(L, "t = {1, 2}");
+    lua_getglobal(L, "t");
+    BOOST_CHECK_EQUAL(apollo::n_conversion_steps<ivec>(L, -1), 0u);
+    BOOST_CHECK_EQUAL(apollo::n_conversion_steps<iarr>(L, -1), 0u);
+    BOOST_CHECK_EQUAL(
+        (apollo::n_conversion_steps<std::array<int, 3>>(L, -1)),
+        apollo::no_conversion);
+    BOOST_CHECK(apollo::to<iarr>(L, -1) == (iarr{{1, 2}}));
+    lua_pop(L, 1);
+
+    // The worst element determines the steps of the whole sequence.
+    require_dostring(L, "t = {1, '2'}");
+    lua_getglobal(L, "t");
+    BOOST_CHECK_EQUAL(apollo::n_conversion_steps<ivec>(L, -1), 2u);
+    BOOST_CHECK(apollo::to<ivec>(L, -1) == (ivec{1, 2}));
+    lua_pop(L, 1);
+
+    require_dostring(L, "t = {1, 2, {}}");
+    lua_getglobal(L, "t");
+    BOOST_CHECK_EQUAL(apollo::n_conversion_steps<ivec>(L, -1),
+        apollo::no_conversion);
+    BOOST_CHECK_THROW(apollo::to<ivec>(L, -1), apollo::to_cpp_conversion_error);
+    lua_pop(L, 1);
+}
+
+BOOST_AUTO_TEST_CASE(sequence_overloads)
+{
+    luaL_requiref(L, "base", &luaopen_base, true);
+    lua_pop(L, 1);
+
+    apollo::push(L, apollo::make_overloadset(&sum_ints, &sum_sizes));
+    lua_setglobal(L, "f");
+    require_dostring(L, "assert(f{1, 2, 3} == 6)");
+    require_dostring(L, "assert(f{'a', 'bc'} == 3)");
+
+    lua_pushcfunction(L, APOLLO_TO_RAW_FUNCTION(&sum_ints));
+    lua_setglobal(L, "g");
+    require_dostring(L, "assert(g{1, 2, 3} == 6)");
+    require_dostring(L, "assert(not pcall(g, {1, 'x'}))");
+}
+
+#include "test_suffix.hpp"
@@ -4,8 +4,10 @@
 
 #include <apollo/builtin_types.hpp>
 #include <apollo/raw_function.hpp>
+#include <apollo/to_raw_function.hpp>
 #include <apollo/stack_balance.hpp>
 
+#include <algorithm>
 #include <cstring>
 
 #include "test_prefix.hpp"
@@ -196,6 +198,44 @@ BOOST_AUTO_TEST_CASE(string_converter)
     lua_pop(L, 1);
 }
 
+static std::size_t count_a(boost::string_ref s)
+{
+    return static_cast<std::size_t>(std::count(s.begin(), s.end(), 'a'));
+}
+
+BOOST_AUTO_TEST_CASE(string_ref_converter)
+{
+    auto const& str = "abc\0def";
+    apollo::push(L, boost::string_ref(str, sizeof(str) - 1));
+    check_streq(L, str, sizeof(str));
+    check_str_roundtrip(L, boost::string_ref("abc"));
+
+    // The string is borrowed from Lua, not copied.
+    std::string const long_str(100, 'a');
+    apollo::push(L, long_str);
+    auto ref = apollo::to<boost::string_ref>(L, -1);
+    BOOST_CHECK_EQUAL(ref.data(), lua_tostring(L, -1));
+    BOOST_CHECK_EQUAL(ref.size(), long_str.size());
+    BOOST_CHECK_EQUAL(
+        apollo::to<boost::string_ref const&>(L, -1).data(), ref.data());
+    lua_pop(L, 1);
+
+    apollo::push(L, 42);
+    BOOST_CHECK_EQUAL(
+        apollo::n_conversion_steps<boost::string_ref>(L, -1), 2u);
+    BOOST_CHECK_EQUAL(apollo::to<boost::string_ref>(L, -1), "42");
+    apollo::push(L, true);
+    BOOST_CHECK_THROW(
+        apollo::to<boost::string_ref>(L, -1), apollo::conversion_error);
+    lua_pop(L, 2);
+
+    lua_pushcfunction(L, APOLLO_TO_RAW_FUNCTION(&count_a));
+    apollo::push(L, "banana");
+    lua_call(L, 1, 1);
+    BOOST_CHECK_EQUAL(apollo::to<std::size_t>(L, -1), 3u);
+    lua_pop(L, 1);
+}
+
 BOOST_AUTO_TEST_CASE(multi_push)
 {
     apollo::push(L, 1.2, false, "foo", 42);
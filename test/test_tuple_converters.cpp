@@ -0,0 +1,105 @@
+// Part of the apollo library -- Copyright (c) Christian Neumüller 2015
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include <apollo/builtin_types.hpp>
+#include <apollo/function.hpp>
+#include <apollo/stack_balance.hpp>
+#include <apollo/to_raw_function.hpp>
+#include <apollo/tuple_converters.hpp>
+
+#include "test_prefix.hpp"
+
+namespace {
+
+std::pair<double, double> get_position()
+{
+    return {1.5, -2};
+}
+
+std::tuple<int, std::string, bool> get_record()
+{
+    return std::make_tuple(42, "foo", true);
+}
+
+int add_offset(std::pair<int, int> const& p, int offset)
+{
+    return p.first + p.second + offset;
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE(tuple_push)
+{
+    apollo::stack_balance balance(L);
+    BOOST_CHECK_EQUAL(apollo::push(L, std::make_tuple(1, "two", 3.5)), 3);
+    BOOST_CHECK_EQUAL(lua_gettop(L), 3);
+    BOOST_CHECK_EQUAL(lua_tointeger(L, 1), 1);
+    BOOST_CHECK_EQUAL(lua_tostring(L, 2), std::string("two"));
+    BOOST_CHECK_EQUAL(lua_tonumber(L, 3), 3.5);
+    lua_settop(L, 0);
+
+    BOOST_CHECK_EQUAL(apollo::push(L, std::tuple<>()), 0);
+    BOOST_CHECK_EQUAL(apollo::push(L, std::make_pair(true, 2)), 2);
+    BOOST_CHECK_EQUAL(apollo::push(L, std::make_tuple(
+        0, std::make_pair(1, 2))), 3);
+    BOOST_CHECK_EQUAL(lua_gettop(L), 5);
+    BOOST_CHECK_EQUAL(lua_tointeger(L, 5), 2);
+    lua_settop(L, 0);
+}
+
+BOOST_AUTO_TEST_CASE(tuple_pull)
+{
+    apollo::stack_balance balance(L);
+    using tuple_t = std::tuple<int, std::pair<double, std::string>>;
+    static_assert(apollo::converter<tuple_t>::n_consumed == 3, "");
+
+    apollo::push(L, 1, 2.5, "x", "rest");
+    int next_idx;
+    BOOST_CHECK_EQUAL(apollo::n_conversion_steps<tuple_t>(L, 1, &next_idx), 0u);
+    BOOST_CHECK_EQUAL(next_idx, 4);
+    auto const t = apollo::to<tuple_t>(L, 1);
+    BOOST_CHECK_EQUAL(std::get<0>(t), 1);
+    BOOST_CHECK_EQUAL(std::get<1>(t).first, 2.5);
+    BOOST_CHECK_EQUAL(std::get<1>(t).second, "x");
+    BOOST_CHECK(apollo::to<tuple_t const&>(L, 1) == t);
+
+    // The worst element determines the steps; all elements must be present.
+    BOOST_CHECK_EQUAL((apollo::n_conversion_steps<std::pair<int, int>>(L, 3)),
+        apollo::no_conversion);
+    BOOST_CHECK_EQUAL((apollo::n_conversion_steps<std::pair<int, int>>(L, 1)),
+        1u); // 2.5 is not an integer.
+    BOOST_CHECK_EQUAL(
+        (apollo::n_conversion_steps<std::tuple<int, int, int>>(L, 3)),
+        apollo::no_conversion);
+    BOOST_CHECK_THROW(
+        (apollo::to<std::tuple<int, double, int>>(L, 1)),
+        apollo::to_cpp_conversion_error);
+    BOOST_CHECK_THROW(
+        (apollo::to<std::pair<std::string, std::string>>(L, 4)),
+        apollo::to_cpp_conversion_error);
+    lua_settop(L, 0);
+}
+
+BOOST_AUTO_TEST_CASE(tuple_functions)
+{
+    luaL_requiref(L, "base", &luaopen_base, true);
+    lua_pop(L, 1);
+    lua_pushcfunction(L, APOLLO_TO_RAW_FUNCTION(&get_position));
+    lua_setglobal(L, "get_position");
+    apollo::push(L, &get_record);
+    lua_setglobal(L, "get_record");
+    lua_pushcfunction(L, APOLLO_TO_RAW_FUNCTION(&add_offset));
+    lua_setglobal(L, "add_offset");
+
+    require_dostring(L,
+        "local x, y = get_position()\n"
+        "assert(x == 1.5 and y == -2)\n"
+        "assert(select('#', get_record()) == 3)\n"
+        "local n, s, b = get_record()\n"
+        "assert(n == 42 and s == 'foo' and b == true)\n"
+        "assert(add_offset(1, 2, 3) == 6)\n"
+        "assert(not pcall(add_offset, 1, 2))");
+}
+
+#include "test_suffix.hpp"